@@ -6,50 +6,92 @@
 #include <unordered_map>
 #include <limits>
 #include <cstring> // Include this header for memcpy and memset
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <system_error>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include "HATDecode.h"
+#include "HATProbe.h"
 #include "HATFormat.h" // Include this header for HATHeader
 
 class HATEditor {
 public:
-    HATEditor(const std::string& filePath) : filePath(filePath), decoder(filePath) {
-        decoder.decode();
-        loadFile();
+    // Opening reads only the header and metadata chunk; the audio is not
+    // touched unless verifyAudio() is called
+    HATEditor(const std::string& filePath) : filePath(filePath) {
         loadHeader();
     }
 
-    void loadFile() {
-        std::ifstream file(filePath, std::ios::binary);
-        if (file.is_open()) {
-            fileData.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-            file.close();
-        } else {
-            throw std::runtime_error("Failed to open file.");
+    void loadHeader() {
+        HATProbe probe;
+        if (!probe.open(filePath)) {
+            throw std::runtime_error("Failed to read the HAT header.");
         }
+        header = probe.getHeader();
+        trackInfo = probe.getTrackInfo();
     }
 
-    void saveFile(const std::string& outputFilePath) {
-        std::ofstream file(outputFilePath, std::ios::binary);
-        if (file.is_open()) {
-            file.write(fileData.data(), fileData.size());
-            file.close();
-        } else {
-            throw std::runtime_error("Failed to save file.");
+    // Decodes the audio of every track a block at a time, checking the
+    // checksums, without holding more than a block in memory
+    bool verifyAudio() const {
+        HATDecoder decoder(filePath);
+        if (!decoder.open()) {
+            return false;
         }
-    }
 
-    void loadHeader() {
-        if (fileData.size() >= sizeof(HATHeader)) {
-            std::memcpy(&header, fileData.data(), sizeof(HATHeader));
-        } else {
-            throw std::runtime_error("File too small to contain a valid header.");
+        std::vector<int16_t> block;
+        for (int track = 0; track < decoder.getTracks(); ++track) {
+            if (!decoder.selectTrack(static_cast<uint32_t>(track))) {
+                return false;
+            }
+            block.resize(static_cast<size_t>(HAT_BLOCK_FRAMES) * decoder.getChannels());
+            uint64_t frames = 0;
+            size_t count;
+            while ((count = decoder.read(block.data(), HAT_BLOCK_FRAMES)) > 0) {
+                frames += count;
+            }
+            if (frames != decoder.getFrameCount()) {
+                std::cerr << "\033[31mTrack " << track << ": decoded " << frames << " of " << decoder.getFrameCount() << " frames.\033[0m" << std::endl;
+                return false;
+            }
         }
+        std::cout << "\033[32mAudio verified: " << decoder.getTracks() << " track(s) decode without errors.\033[0m" << std::endl;
+        return true;
     }
 
-    void saveHeader() {
-        if (fileData.size() >= sizeof(HATHeader)) {
-            std::memcpy(fileData.data(), &header, sizeof(HATHeader));
+    // Saves the edits to outputFilePath, or to the file itself when it is
+    // empty. Metadata that still fits its chunk is written over the old one
+    // with a single positioned write, however large the file. Otherwise the
+    // file is rewritten with a larger chunk; the audio after it is copied
+    // unchanged, since every offset in it is relative to the start of the
+    // audio data.
+    void saveFile(const std::string& outputFilePath) {
+        bool sameFile = outputFilePath.empty() || isSameFile(outputFilePath);
+        HATHeader saved = header;
+        uint32_t needed = getMetadataChunkSize(trackInfo.metadata);
+        if (needed > HAT_MAX_METADATA_SIZE) {
+            throw std::runtime_error("The metadata is too large to save.");
+        }
+        if (needed > saved.metadataSize) {
+            saved.metadataSize = std::min(needed + HAT_METADATA_PADDING, HAT_MAX_METADATA_SIZE);
+        }
+
+        std::vector<uint8_t> headerData(HAT_HEADER_SIZE + saved.metadataSize);
+        packHATHeader(saved, trackInfo, headerData.data());
+        packMetadata(trackInfo.metadata, headerData.data() + HAT_HEADER_SIZE, saved.metadataSize);
+
+        if (sameFile && saved.metadataSize == header.metadataSize) {
+            writeInPlace(headerData);
         } else {
-            throw std::runtime_error("File too small to contain a valid header.");
+            rewrite(sameFile ? filePath : outputFilePath, headerData);
+        }
+        if (sameFile) {
+            header.metadataSize = saved.metadataSize;
         }
     }
 
@@ -68,22 +110,27 @@ public:
 
     void printTrackInfo() {
         std::cout << "Track Information:" << std::endl;
-        std::cout << "Artist: " << decoder.getArtist() << std::endl;
-        std::cout << "Description: " << decoder.getDescription() << std::endl;
-        std::cout << "Track Name: " << decoder.getTrackName() << std::endl;
-        std::cout << "Track Number: " << decoder.getTrackNumber() << std::endl;
+        std::cout << "Artist: " << getMetadataValue(trackInfo, "artist") << std::endl;
+        std::cout << "Description: " << getMetadataValue(trackInfo, "description") << std::endl;
+        std::cout << "Track Name: " << getMetadataValue(trackInfo, "trackName") << std::endl;
+        std::cout << "Track Number: " << trackInfo.trackNumber << std::endl;
+        for (const auto& [key, value] : trackInfo.metadata) {
+            if (key != "artist" && key != "description" && key != "trackName") {
+                std::cout << key << ": " << value << std::endl;
+            }
+        }
     }
 
     void editArtist(const std::string& newArtist) {
-        updateField(decoder.getArtist(), newArtist);
+        updateField("artist", newArtist);
     }
 
     void editTrackName(const std::string& newTrackName) {
-        updateField(decoder.getTrackName(), newTrackName);
+        updateField("trackName", newTrackName);
     }
 
     void editDescription(const std::string& newDescription) {
-        updateField(decoder.getDescription(), newDescription);
+        updateField("description", newDescription);
     }
 
     void editVersion(const std::string& newVersion) {
@@ -123,6 +170,15 @@ public:
         pendingChanges.push_back("Updated bit rate to " + std::to_string(newBitRate));
     }
 
+    // Sets any metadata entry, e.g. "album" or "label"
+    void editMetadata(const std::string& key, const std::string& value) {
+        updateField(key, value);
+    }
+
+    bool hasPendingChanges() const {
+        return !pendingChanges.empty();
+    }
+
     void viewPendingChanges() const {
         std::cout << "Pending Changes:" << std::endl;
         for (size_t i = 0; i < pendingChanges.size(); ++i) {
@@ -140,23 +196,95 @@ public:
     }
 
 private:
-    void updateField(const std::string& oldValue, const std::string& newValue) {
-        if (oldValue != newValue) {
-            auto pos = std::search(fileData.begin(), fileData.end(), oldValue.begin(), oldValue.end());
-            if (pos != fileData.end()) {
-                std::copy(newValue.begin(), newValue.end(), pos);
-                pendingChanges.push_back("Updated from \"" + oldValue + "\" to \"" + newValue + "\"");
-            } else {
-                std::cerr << "Failed to update: old value not found in file." << std::endl;
-            }
+    void updateField(const std::string& key, const std::string& newValue) {
+        std::string& field = trackInfo.metadata[key];
+        if (field != newValue) {
+            pendingChanges.push_back("Updated from \"" + field + "\" to \"" + newValue + "\"");
+            field = newValue;
+        }
+    }
+
+    bool isSameFile(const std::string& outputFilePath) const {
+        std::error_code error;
+        return std::filesystem::equivalent(filePath, outputFilePath, error);
+    }
+
+    // The metadata chunk is written and synced before the header, so a crash
+    // in between leaves the old header in front of the new metadata rather
+    // than a new header in front of half-written metadata. The header is only
+    // rewritten when its bytes change.
+    void writeInPlace(const std::vector<uint8_t>& headerData) const {
+        size_t metadataSize = headerData.size() - HAT_HEADER_SIZE;
+#ifndef _WIN32
+        int fd = ::open(filePath.c_str(), O_RDWR);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open file for writing.");
+        }
+        auto writeAt = [fd](const uint8_t* data, size_t size, off_t offset) {
+            return ::pwrite(fd, data, size, offset) == static_cast<ssize_t>(size) && ::fsync(fd) == 0;
+        };
+        uint8_t current[HAT_HEADER_SIZE];
+        bool headerChanged = ::pread(fd, current, sizeof(current), 0) != static_cast<ssize_t>(sizeof(current)) ||
+                             !std::equal(current, current + sizeof(current), headerData.begin());
+        bool saved = writeAt(headerData.data() + HAT_HEADER_SIZE, metadataSize, HAT_HEADER_SIZE) &&
+                     (!headerChanged || writeAt(headerData.data(), HAT_HEADER_SIZE, 0));
+        ::close(fd);
+        if (!saved) {
+            throw std::runtime_error("Failed to save file.");
+        }
+#else
+        std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
+        if (!file.is_open() ||
+            !file.seekp(HAT_HEADER_SIZE).write(reinterpret_cast<const char*>(headerData.data() + HAT_HEADER_SIZE), metadataSize).flush() ||
+            !file.seekp(0).write(reinterpret_cast<const char*>(headerData.data()), HAT_HEADER_SIZE).flush()) {
+            throw std::runtime_error("Failed to save file.");
         }
+#endif
     }
 
+    // Writes the new header and metadata followed by the audio of the original
+    // to a temporary file, then renames it over outputFilePath, so a crash
+    // leaves either the old file or the new one
+    void rewrite(const std::string& outputFilePath, const std::vector<uint8_t>& headerData) const {
+        std::ifstream input(filePath, std::ios::binary);
+        if (!input.is_open()) {
+            throw std::runtime_error("Failed to open file.");
+        }
+        input.seekg(static_cast<std::streamoff>(getDataOffset(header)));
+
+        std::string tempFilePath = outputFilePath + ".tmp";
+        std::ofstream output(tempFilePath, std::ios::binary | std::ios::trunc);
+        if (!output.is_open()) {
+            throw std::runtime_error("Failed to save file.");
+        }
+        output.write(reinterpret_cast<const char*>(headerData.data()), headerData.size());
+
+        std::vector<char> buffer(COPY_BUFFER_SIZE);
+        while (input && output) {
+            input.read(buffer.data(), buffer.size());
+            output.write(buffer.data(), input.gcount());
+        }
+        output.close();
+
+        std::error_code error;
+        if (!input.eof() || output.fail()) {
+            std::filesystem::remove(tempFilePath, error);
+            throw std::runtime_error("Failed to save file.");
+        }
+        std::filesystem::permissions(tempFilePath, std::filesystem::status(filePath, error).permissions(), error);
+        std::filesystem::rename(tempFilePath, outputFilePath, error);
+        if (error) {
+            std::filesystem::remove(tempFilePath, error);
+            throw std::runtime_error("Failed to save file.");
+        }
+    }
+
+    static const size_t COPY_BUFFER_SIZE = 1 << 20;
+
     std::string filePath;
-    std::vector<char> fileData;
     std::vector<std::string> pendingChanges;
-    HATDecoder decoder;
     HATHeader header;
+    TrackInfo trackInfo;
 };
 
 void showCommands() {
@@ -175,13 +303,134 @@ void showCommands() {
     std::cout << "12. edit bitrate - Edit bit rate (Warning: Can break HAT audio files)" << std::endl;
     std::cout << "13. view changes - View pending changes" << std::endl;
     std::cout << "14. delete change - Delete a pending change" << std::endl;
-    std::cout << "15. save - Save the edited HAT file" << std::endl;
-    std::cout << "16. exit - Exit the program" << std::endl;
+    std::cout << "15. verify - Decode the audio and check it for damage" << std::endl;
+    std::cout << "16. save - Save the edited HAT file" << std::endl;
+    std::cout << "17. exit - Exit the program" << std::endl;
+}
+
+// One line of a batch manifest: file, field and value separated by tabs
+struct ManifestEdit {
+    std::string field;
+    std::string value;
+};
+
+struct FileEdits {
+    std::string filePath;
+    std::vector<ManifestEdit> edits;
+};
+
+// Metadata key a manifest field name stands for. The interactive command
+// names are accepted; anything else is used as the key itself.
+std::string getMetadataKey(const std::string& field) {
+    if (field == "trackname") {
+        return "trackName";
+    }
+    return field;
+}
+
+// Reads the manifest and groups its edits by file, keeping the files in the
+// order they first appear. Blank lines and lines starting with '#' are skipped.
+bool readManifest(const std::string& manifestPath, std::vector<FileEdits>& files) {
+    std::ifstream manifest(manifestPath);
+    if (!manifest.is_open()) {
+        std::cerr << "Error opening manifest " << manifestPath << "." << std::endl;
+        return false;
+    }
+
+    std::unordered_map<std::string, size_t> fileIndex;
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(manifest, line)) {
+        ++lineNumber;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        size_t firstTab = line.find('\t');
+        size_t secondTab = firstTab == std::string::npos ? std::string::npos : line.find('\t', firstTab + 1);
+        if (secondTab == std::string::npos || firstTab == 0 || secondTab == firstTab + 1) {
+            std::cerr << manifestPath << ":" << lineNumber << ": expected <file> TAB <field> TAB <value>." << std::endl;
+            return false;
+        }
+
+        std::string filePath = line.substr(0, firstTab);
+        auto [it, inserted] = fileIndex.try_emplace(filePath, files.size());
+        if (inserted) {
+            files.push_back({filePath, {}});
+        }
+        files[it->second].edits.push_back({line.substr(firstTab + 1, secondTab - firstTab - 1), line.substr(secondTab + 1)});
+    }
+    return true;
+}
+
+// Applies every edit of one file and saves it in place, which is a single
+// positioned write unless the metadata outgrows its chunk
+bool applyEdits(const FileEdits& file) {
+    try {
+        HATEditor editor(file.filePath);
+        for (const ManifestEdit& edit : file.edits) {
+            editor.editMetadata(getMetadataKey(edit.field), edit.value);
+        }
+        if (editor.hasPendingChanges()) {
+            editor.saveFile("");
+        }
+        return true;
+    } catch (const std::exception& ex) {
+        std::cerr << "Error: " << file.filePath << ": " << ex.what() << std::endl;
+        return false;
+    }
+}
+
+// Edits the files on a fixed pool of threads, each taking the next file in
+// turn. A file's edits are applied and saved together.
+int runBatch(const std::string& manifestPath, unsigned int threads) {
+    std::vector<FileEdits> files;
+    if (!readManifest(manifestPath, files)) {
+        return 1;
+    }
+
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> failed(0);
+    std::vector<std::thread> workers;
+    threads = static_cast<unsigned int>(std::min<size_t>(threads, std::max<size_t>(files.size(), 1)));
+    for (unsigned int i = 0; i < threads; ++i) {
+        workers.emplace_back([&] {
+            for (size_t index = next++; index < files.size(); index = next++) {
+                if (!applyEdits(files[index])) {
+                    failed++;
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    std::cout << "Edited " << files.size() - failed << " of " << files.size() << " files." << std::endl;
+    return failed > 0 ? 1 : 0;
+}
+
+void printUsage() {
+    std::cerr << "Usage: HATEdit <input HAT file>" << std::endl;
+    std::cerr << "       HATEdit --batch <manifest> [--threads N]" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
+    if (argc >= 3 && std::string(argv[1]) == "--batch") {
+        unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+        if (argc == 5 && std::string(argv[3]) == "--threads") {
+            threads = static_cast<unsigned int>(std::max(1, std::atoi(argv[4])));
+        } else if (argc != 3) {
+            printUsage();
+            return 1;
+        }
+        return runBatch(argv[2], threads);
+    }
     if (argc != 2) {
-        std::cerr << "Usage: HATEdit <input HAT file>" << std::endl;
+        printUsage();
         return 1;
     }
 
@@ -195,7 +444,9 @@ int main(int argc, char* argv[]) {
 
         while (true) {
             std::cout << "\nEnter command: ";
-            std::getline(std::cin, command);
+            if (!std::getline(std::cin, command)) {
+                break;
+            }
 
             if (command == "view header") {
                 editor.printHeaderInfo();
@@ -272,13 +523,14 @@ int main(int argc, char* argv[]) {
                 std::cin >> index;
                 std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // clear input buffer
                 editor.deletePendingChange(index);
+            } else if (command == "verify") {
+                editor.verifyAudio();
             } else if (command == "save") {
                 std::string outputFilePath;
-                std::cout << "Enter output file path: ";
+                std::cout << "Enter output file path (empty to save in place): ";
                 std::getline(std::cin, outputFilePath);
-                editor.saveHeader();
                 editor.saveFile(outputFilePath);
-                std::cout << "HAT file saved to " << outputFilePath << std::endl;
+                std::cout << "HAT file saved to " << (outputFilePath.empty() ? inputFilePath : outputFilePath) << std::endl;
             } else if (command == "exit") {
                 break;
             } else {
@@ -1,12 +1,28 @@
 #define DR_WAV_IMPLEMENTATION
 #include "dr_wav.h"
 #include "HATEncode.h"
+#include "HATUpgrade.h"
 #include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
 #include <unordered_map>
 
+void printUsage() {
+    std::cerr << "Usage: HATEncoder <input WAV file> <output HAT file> <artist> [--attach <file> <MIME type>]... [--track <WAV file>]..." << std::endl;
+    std::cerr << "       HATEncoder --upgrade <input HAT 1.0 file> <output HAT file>" << std::endl;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: HATEncoder <input WAV file> <output HAT file> <artist>" << std::endl;
+    if (argc == 4 && std::string(argv[1]) == "--upgrade") {
+        if (!upgradeHATFile(argv[2], argv[3])) {
+            return 1;
+        }
+        std::cout << "Upgrade complete." << std::endl;
+        return 0;
+    }
+    if (argc < 4) {
+        printUsage();
         return 1;
     }
 
@@ -22,7 +38,6 @@ int main(int argc, char* argv[]) {
 
     int sampleRate = wav.sampleRate;
     int audioChannels = wav.channels;
-    int bitsPerSample = wav.bitsPerSample;
     int byteRate = wav.bitsPerSample * wav.channels * wav.sampleRate / 8;
 
     int bitRate = byteRate * 8; // Convert byte rate to bit rate
@@ -30,14 +45,34 @@ int main(int argc, char* argv[]) {
     std::unordered_map<std::string, std::string> metadata;
     metadata["artist"] = artist;
 
-    // Read PCM frames
-    std::vector<int16_t> audioData(wav.totalPCMFrameCount * wav.channels);
-    drwav_read_pcm_frames_s16(&wav, wav.totalPCMFrameCount, audioData.data());
-
+    // The encoder streams the PCM frames itself
     drwav_uninit(&wav);
 
     HATEncoder encoder(inputFilePath, outputFilePath, sampleRate, bitRate, audioChannels, metadata);
-    encoder.encode();
+    for (int i = 4; i < argc; ++i) {
+        if (std::string(argv[i]) == "--track" && i + 1 < argc) {
+            encoder.addTrack(argv[++i]);
+            continue;
+        }
+        if (std::string(argv[i]) != "--attach" || i + 2 >= argc) {
+            printUsage();
+            return 1;
+        }
+        std::string attachmentPath = argv[++i];
+        std::string mimeType = argv[++i];
+
+        std::ifstream attachmentFile(attachmentPath, std::ios::binary);
+        if (!attachmentFile.is_open()) {
+            std::cerr << "Failed to open attachment " << attachmentPath << "." << std::endl;
+            return 1;
+        }
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(attachmentFile)), std::istreambuf_iterator<char>());
+        // Stored under its file name, without the directory
+        encoder.addAttachment(attachmentPath.substr(attachmentPath.find_last_of("/\\") + 1), mimeType, data);
+    }
+    if (!encoder.encode()) {
+        return 1;
+    }
 
     std::cout << "Encoding complete." << std::endl;
     return 0;
@@ -0,0 +1,296 @@
+#include "HATProbe.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstdio>
+#include <cctype>
+
+namespace fs = std::filesystem;
+
+// Files handed to a worker at a time, and batches queued per worker. Together
+// they bound how many paths are held while walking a large tree.
+const size_t BATCH_FILES = 256;
+const size_t QUEUED_BATCHES_PER_WORKER = 2;
+
+// Binary index: "HATX", format version and record count, then one record per file
+const uint32_t INDEX_MAGIC = 0x58544148; // "HATX"
+const uint32_t INDEX_VERSION = 1;
+
+enum IndexFormat {
+    CSV,
+    BINARY
+};
+
+// Bounded queue of path batches between the directory walker and the workers
+class BatchQueue {
+public:
+    explicit BatchQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+    void push(std::vector<std::string>&& batch) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return batches.size() < capacity; });
+        batches.push_back(std::move(batch));
+        notEmpty.notify_one();
+    }
+
+    // Returns false once the queue is closed and empty
+    bool pop(std::vector<std::string>& batch) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return !batches.empty() || closed; });
+        if (batches.empty()) {
+            return false;
+        }
+        batch = std::move(batches.front());
+        batches.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+    }
+
+private:
+    std::deque<std::vector<std::string>> batches;
+    size_t capacity;
+    bool closed;
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+};
+
+// Collects formatted records from the workers. Each worker hands over a whole
+// batch at once, so the output file sees one write per batch.
+class IndexWriter {
+public:
+    IndexWriter(std::ofstream& output, IndexFormat format) : output(output), format(format), records(0) {}
+
+    bool begin() {
+        if (format == CSV) {
+            output << "path,duration,channels,sample_rate,compression_method,artist,track_name\n";
+        } else {
+            std::string start;
+            appendU32(start, INDEX_MAGIC);
+            appendU32(start, INDEX_VERSION);
+            appendU64(start, 0); // Record count, patched by finish()
+            output.write(start.data(), start.size());
+        }
+        return static_cast<bool>(output);
+    }
+
+    void appendRecord(std::string& batch, const std::string& path, const HATProbe& probe) const {
+        const HATHeader& header = probe.getHeader();
+        if (format == CSV) {
+            char number[32];
+            std::snprintf(number, sizeof(number), "%.3f", probe.getDuration());
+            appendQuoted(batch, path);
+            batch += ',';
+            batch += number;
+            batch += ',' + std::to_string(header.channels) + ',' + std::to_string(header.sampleRate) + ',';
+            batch += compressionMethodName(header.compressionMethod);
+            batch += ',';
+            appendQuoted(batch, probe.getArtist());
+            batch += ',';
+            appendQuoted(batch, probe.getTrackName());
+            batch += '\n';
+        } else {
+            // Duration is stored exactly, as a frame count and sample rate
+            appendString(batch, path);
+            appendU64(batch, probe.getFrameCount());
+            appendU32(batch, header.sampleRate);
+            batch += static_cast<char>(header.channels);
+            batch += static_cast<char>(header.compressionMethod);
+            appendString(batch, probe.getArtist());
+            appendString(batch, probe.getTrackName());
+        }
+    }
+
+    void write(const std::string& batch, uint64_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        output.write(batch.data(), batch.size());
+        records += count;
+    }
+
+    bool finish() {
+        if (format == BINARY) {
+            std::string count;
+            appendU64(count, records);
+            output.seekp(2 * sizeof(uint32_t));
+            output.write(count.data(), count.size());
+        }
+        output.flush();
+        return static_cast<bool>(output);
+    }
+
+    uint64_t getRecords() const { return records; }
+
+private:
+    std::ofstream& output;
+    IndexFormat format;
+    uint64_t records;
+    std::mutex mutex;
+
+    static const char* compressionMethodName(CompressionMethod method) {
+        switch (method) {
+        case LOSSLESS:
+            return "LOSSLESS";
+        }
+        return "UNKNOWN";
+    }
+
+    static void appendQuoted(std::string& out, const std::string& value) {
+        out += '"';
+        for (char c : value) {
+            if (c == '"') {
+                out += '"';
+            }
+            out += c;
+        }
+        out += '"';
+    }
+
+    static void appendU32(std::string& out, uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            out += static_cast<char>(value >> (8 * i));
+        }
+    }
+
+    static void appendU64(std::string& out, uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            out += static_cast<char>(value >> (8 * i));
+        }
+    }
+
+    // Strings are a 16-bit little-endian length followed by the bytes
+    static void appendString(std::string& out, const std::string& value) {
+        size_t length = std::min<size_t>(value.size(), UINT16_MAX);
+        out += static_cast<char>(length);
+        out += static_cast<char>(length >> 8);
+        out.append(value, 0, length);
+    }
+};
+
+// Probes every file of each batch and writes the records in one go
+void indexWorker(BatchQueue& queue, IndexWriter& writer, std::atomic<uint64_t>& skipped) {
+    std::vector<std::string> batch;
+    std::string records;
+    HATProbe probe;
+    while (queue.pop(batch)) {
+        records.clear();
+        uint64_t count = 0;
+        for (const std::string& path : batch) {
+            if (!probe.open(path)) {
+                skipped++;
+                continue;
+            }
+            writer.appendRecord(records, path, probe);
+            count++;
+        }
+        writer.write(records, count);
+    }
+}
+
+bool isHATFile(const fs::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension == ".hat";
+}
+
+void printUsage() {
+    std::cerr << "Usage: HATIndex <directory> <output index> [--threads N] [--binary]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || argv[1][0] == '-' || argv[2][0] == '-') {
+        printUsage();
+        return 1;
+    }
+
+    std::string rootPath = argv[1];
+    std::string outputPath = argv[2];
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    IndexFormat format = CSV;
+
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--binary") {
+            format = BINARY;
+        } else if (i + 1 < argc && arg == "--threads") {
+            threads = static_cast<unsigned int>(std::max(1, std::atoi(argv[++i])));
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::error_code error;
+    if (!fs::is_directory(rootPath, error)) {
+        std::cerr << "Error: " << rootPath << " is not a directory." << std::endl;
+        return 1;
+    }
+
+    std::ofstream output(outputPath, std::ios::binary);
+    IndexWriter writer(output, format);
+    if (!output.is_open() || !writer.begin()) {
+        std::cerr << "Error opening output file." << std::endl;
+        return 1;
+    }
+
+    BatchQueue queue(threads * QUEUED_BATCHES_PER_WORKER);
+    std::atomic<uint64_t> skipped(0);
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < threads; ++i) {
+        workers.emplace_back(indexWorker, std::ref(queue), std::ref(writer), std::ref(skipped));
+    }
+
+    // Walk the tree on this thread, handing paths to the workers a batch at a time
+    std::vector<std::string> batch;
+    batch.reserve(BATCH_FILES);
+    fs::recursive_directory_iterator it(rootPath, fs::directory_options::skip_permission_denied, error);
+    for (; !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+        std::error_code statError;
+        if (!isHATFile(it->path()) || !it->is_regular_file(statError)) {
+            continue;
+        }
+        batch.push_back(it->path().string());
+        if (batch.size() == BATCH_FILES) {
+            queue.push(std::move(batch));
+            batch.clear();
+            batch.reserve(BATCH_FILES);
+        }
+    }
+    if (error) {
+        std::cerr << "Error walking " << rootPath << ": " << error.message() << std::endl;
+    }
+    if (!batch.empty()) {
+        queue.push(std::move(batch));
+    }
+
+    queue.close();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    if (!writer.finish()) {
+        std::cerr << "Error writing output file." << std::endl;
+        return 1;
+    }
+
+    std::cout << "Indexed " << writer.getRecords() << " files";
+    if (skipped > 0) {
+        std::cout << ", skipped " << skipped << " unreadable";
+    }
+    std::cout << "." << std::endl;
+    return error ? 1 : 0;
+}
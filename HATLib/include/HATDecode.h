@@ -3,24 +3,83 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 #include <cstdint> // Ensure this is included
 #include "HATFormat.h"
+#include "HATIO.h"
 
 class HATDecoder {
 public:
     HATDecoder(const std::string& inputFilePath);
+    // Decodes from any byte source, e.g. a HATMemorySource over an asset that is
+    // already in RAM. The source is not owned and must outlive the decoder.
+    HATDecoder(HATSource& source);
+    HATDecoder(const HATDecoder&) = delete;
+    HATDecoder& operator=(const HATDecoder&) = delete;
     void decode();
-    
+
+    // Reads the header, track info and coarse seek index without decoding any
+    // audio. Afterwards read() streams the track a block at a time, so memory use
+    // stays at about one block no matter how long the file is. seek(), read() and
+    // decodeRange() call this themselves if needed.
+    bool open();
+    // True once open() has succeeded
+    bool isOpen() const { return indexLoaded; }
+    // Switches to track `track` (counting from 0) of a multi-track file and
+    // opens it. Only that track's header, metadata and seek index are read.
+    // Files with a single track only have track 0.
+    bool selectTrack(uint32_t track);
+
+    // Moves the play position to the given frame. Only the block holding that
+    // frame is read and decompressed; the frames before it in the block are skipped.
+    bool seek(uint64_t frame);
+    // Reads up to `frames` interleaved frames from the play position into dst.
+    // Returns the number of frames read, which is short only at the end of the track.
+    size_t read(int16_t* dst, size_t frames);
+    // Decodes frames [firstFrame, firstFrame + frameCount) into out, reading and
+    // decompressing only the blocks that overlap the range. The play position is
+    // left where it was. Returns the number of frames written, which is short
+    // when the range runs past the end of the track.
+    size_t decodeRange(uint64_t firstFrame, uint64_t frameCount, int16_t* out);
+    // Mixes several tracks of a multi-track file, such as stems, scaling track
+    // tracks[i] by gains[i]. The tracks must have the same channel count and
+    // sample rate. Each is decoded a block at a time into one shared
+    // accumulator, so memory use stays at about one block per track. The mix
+    // is read with readMix() and is as long as its longest track.
+    bool setMix(const std::vector<uint32_t>& tracks, const std::vector<float>& gains);
+    // Changes the gain of mixed track `index` (an index into the setMix()
+    // list). Tracks at gain 0 are not decoded at all.
+    bool setMixGain(size_t index, float gain);
+    bool seekMix(uint64_t frame);
+    // Reads up to `frames` interleaved frames of the mix into dst. Returns the
+    // number of frames read, which is short only at the end of the mix.
+    size_t readMix(int16_t* dst, size_t frames);
+    uint64_t getMixPosition() const { return mixPosition; }
+    uint64_t getMixFrameCount() const { return mixFrameCount; }
+
+    // Lists the attachments (cover art, lyrics, ...). The attachment directory
+    // is read the first time this or readAttachment() is called; opening and
+    // playing a file never reads it.
+    const std::vector<AttachmentInfo>& getAttachments();
+    // Reads the data of attachment `id` and checks its CRC
+    bool readAttachment(uint32_t id, std::vector<uint8_t>& data);
+
+    uint64_t getPosition() const { return position; }
+    uint64_t getFrameCount() const { return header.channels ? header.length / header.channels : 0; }
+
     int getSampleRate() const { return header.sampleRate; }
     int getBitRate() const { return header.bitRate; }
     int getChannels() const { return header.channels; }
-    int getTracks() const { return header.tracks; }
+    // Tracks in the file; everything else describes the selected track
+    int getTracks() const { return static_cast<int>(trackCount); }
+    uint32_t getSelectedTrack() const { return trackIndex; }
     float getCompressionRatio() const { return header.compressionRatio; }
     const std::string& getVersion() const { return header.version; }
     const float* getSpatialData() const { return header.spatialData; }
-    const std::string& getArtist() const { return trackInfo.artist; }
-    const std::string& getDescription() const { return trackInfo.description; }
-    const std::string& getTrackName() const { return trackInfo.trackName; }
+    const std::string& getArtist() const { return getMetadataValue(trackInfo, "artist"); }
+    const std::string& getDescription() const { return getMetadataValue(trackInfo, "description"); }
+    const std::string& getTrackName() const { return getMetadataValue(trackInfo, "trackName"); }
+    const std::map<std::string, std::string>& getMetadata() const { return trackInfo.metadata; }
     int getTrackNumber() const { return trackInfo.trackNumber; }
     const std::vector<int16_t>& getAudioData() const { return audioData; }
     std::vector<int16_t> decompressData(const std::vector<uint8_t>& compressedData, size_t dataSize); 
@@ -32,8 +91,46 @@ private:
     TrackInfo trackInfo;
     std::vector<int16_t> audioData;
 
-    void readHATHeader(std::ifstream& inputFile, HATHeader& header);
-    void readTrackInfo(std::ifstream& inputFile, TrackInfo& trackInfo);
+    // Opened from inputFilePath by open() unless a source was passed in.
+    // `source` is the selected track: the whole file, or a range of it when
+    // the file holds several tracks.
+    std::unique_ptr<HATSource> ownedSource;
+    HATSource* fileSource;
+    std::unique_ptr<HATRangeSource> trackSource;
+    HATSource* source;
+    uint32_t trackIndex;
+    uint32_t trackCount;
+
+    // State used by seek() and read()
+    SeekIndexHeader seekIndex;
+    std::vector<uint64_t> coarseIndex;
+    std::vector<uint64_t> finePage; // Only the most recently used fine page is kept
+    uint64_t finePageIndex;
+    std::vector<uint8_t> compressedBlock;
+    std::vector<int16_t> blockData;
+    uint64_t blockIndex;
+    uint64_t position;
+    bool indexLoaded;
+
+    std::vector<AttachmentInfo> attachments;
+    uint64_t attachmentDirectoryEnd; // File offset just past the directory, once loaded
+    bool attachmentsLoaded;
+
+    // State used by setMix() and readMix(): one decoder per mixed track, all
+    // reading from fileSource
+    std::vector<std::unique_ptr<HATDecoder>> mixTracks;
+    std::vector<float> mixGains;
+    std::vector<int16_t> mixBlock;
+    std::vector<float> mixAccumulator;
+    uint64_t mixPosition;
+    uint64_t mixFrameCount;
+
+    bool readHeader();
+    bool openTrack(const uint8_t* directoryHeader);
+    bool readBlock(uint64_t offset, uint64_t frames, bool randomAccess, std::vector<int16_t>& blockSamples);
+    bool findBlock(uint64_t index, uint64_t& offset);
+    bool loadBlock(uint64_t index, bool randomAccess);
+    bool loadAttachments();
 
 };
 
@@ -10,8 +10,14 @@
 class HATEncoder {
 public:
     HATEncoder(const std::string& inputFilePath, const std::string& outputFilePath, int sampleRate, int bitRate, int audioChannels, const std::unordered_map<std::string, std::string>& metadata);
-    void encode();
-    
+    // Fails, with a message, if a WAV file cannot be read or the output cannot be written
+    bool encode();
+    // Embeds an attachment such as cover art or lyrics in the encoded file
+    void addAttachment(const std::string& name, const std::string& mimeType, const std::vector<uint8_t>& data);
+    // Adds another WAV file as a further track, making a multi-track file.
+    // Each track is named after its WAV file; attachments go with the first.
+    void addTrack(const std::string& inputFilePath);
+
 private:
     std::string inputFilePath;
     std::string outputFilePath;
@@ -19,10 +25,9 @@ private:
     int bitRate;
     int audioChannels;
     std::unordered_map<std::string, std::string> metadata;
-    std::vector<int16_t> audioData;
-
-    void readWavFile();
-    void writeHATFile(const HATHeader& header, const TrackInfo& trackInfo, const std::vector<uint8_t>& compressedData);
+    std::vector<AttachmentInfo> attachments;
+    std::vector<std::vector<uint8_t>> attachmentData;
+    std::vector<std::string> trackFilePaths; // Tracks after the first
 };
 
 #endif
@@ -4,9 +4,66 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <map>
 #include <cstdint> // Ensure this is included
+#include <iosfwd>
 
-const std::string HAT_VERSION = "1.0";
+const std::string HAT_VERSION = "1.8";
+
+// Every file starts with a fixed header record packed little-endian and closed
+// by a CRC32 of the fields before it. Lengths and offsets are 8 bytes wide, so
+// day-long recordings past 4 GB are described exactly.
+const size_t HAT_HEADER_SIZE = 84;
+
+// The metadata chunk follows the header and takes up HATHeader::metadataSize
+// bytes, so a reader that does not need it skips it in one seek. It holds the
+// sync word, the size of the entries, a CRC32 of the entries and then the
+// entries themselves: a 2 byte key length, the key, a 4 byte value length and
+// the value. The rest of the chunk is zero padding that lets metadata grow in
+// place.
+const uint32_t HAT_METADATA_SYNC = 0x4D544148; // "HATM"
+const size_t HAT_METADATA_HEADER_SIZE = 12;
+const uint32_t HAT_METADATA_PADDING = 128; // Free bytes the encoder reserves by default
+// Largest metadata chunk, padding included, that is written or read. Readers
+// allocate the chunk before its CRC can be checked, so a damaged or hostile
+// header must not be able to ask for more. Bulky data belongs in attachments.
+const uint32_t HAT_MAX_METADATA_SIZE = 16 * 1024 * 1024;
+
+// Attachments (cover art, lyrics, ...) are stored after the coarse seek index,
+// followed by a directory that HATHeader::attachmentDirectory points at. The
+// directory is laid out like the metadata chunk: the sync word, the size of
+// its entries and a CRC32 of them, then per attachment its id (4 bytes),
+// offset and size (8 bytes each), a CRC32 of its data and its name and MIME
+// type, each a 2 byte length and the bytes. Playback never reads any of it.
+const uint32_t HAT_ATTACHMENT_SYNC = 0x44544148; // "HATD"
+const size_t HAT_ATTACHMENT_HEADER_SIZE = 12;
+
+// A multi-track file (stems, dubs, alternate mixes) has a track directory where
+// the audio data would start. It holds the sync word, the size of its entries
+// and a CRC32 of them, then per track the offset and size (8 bytes each) of a
+// complete single-track file image. Offsets count from the start of the
+// container's audio data, and each image's own offsets from its own audio
+// data, so a track is read where it lies without touching the others.
+const uint32_t HAT_TRACK_SYNC = 0x54544148; // "HATT"
+const size_t HAT_TRACK_HEADER_SIZE = 12;
+const size_t HAT_TRACK_ENTRY_SIZE = 16;
+
+// Audio is stored as a sequence of independently decodable blocks of
+// HAT_BLOCK_FRAMES frames each (the last block may be shorter).
+const uint32_t HAT_BLOCK_FRAMES = 4096;
+const uint32_t HAT_BLOCK_SYNC = 0x42544148; // "HATB"
+
+// The seek index is split in two levels. Fine pages hold the offsets of up to
+// HAT_SEEK_PAGE_ENTRIES consecutive blocks and are written between the blocks
+// as soon as they fill; the coarse index at the seek marker holds the offset of
+// every fine page and is the only part read at open.
+const uint32_t HAT_SEEK_PAGE_ENTRIES = 1024;
+const uint32_t HAT_PAGE_SYNC = 0x50544148;  // "HATP"
+const uint32_t HAT_INDEX_SYNC = 0x49544148; // "HATI"
+
+// Live recordings write a checkpoint after every sync interval so an unfinished
+// file can be recovered by recoverHATFile() without scanning all of it.
+const uint32_t HAT_CHECKPOINT_SYNC = 0x4B544148; // "HATK"
 
 enum CompressionMethod {
     LOSSLESS
@@ -21,20 +78,143 @@ struct HATHeader {
     uint8_t tracks;
     uint32_t sampleRate;
     uint32_t bitRate;
-    uint32_t length;
-    uint32_t datalength;
+    uint64_t length;     // Samples in the track, all channels counted
+    uint64_t datalength; // Bytes of audio data before the seek index
+    uint32_t blockFrames;
+    uint32_t metadataSize; // Bytes taken by the metadata chunk, padding included
+    uint64_t attachmentDirectory; // Offset of the attachment directory from the start of the audio data, 0 if none
 };
 
 struct TrackInfo {
-    std::string artist;
-    std::string description;
-    std::string trackName;
+    std::map<std::string, std::string> metadata; // e.g. "artist", "description", "trackName"
     int32_t trackNumber;
-    uint32_t seekMarker;
+    uint64_t seekMarker; // Offset of the coarse seek index from the start of the audio data
+};
+
+struct AttachmentInfo {
+    uint32_t id;
+    std::string name;
+    std::string mimeType;
+    uint64_t offset; // From the start of the audio data
+    uint64_t size;
+    uint32_t crc;    // CRC32 of the attachment data
+};
+
+struct TrackDirectoryEntry {
+    uint64_t offset; // From the start of the container's audio data
+    uint64_t size;
+};
+
+// Offset of the audio data, which every offset in the seek index and
+// checkpoints is relative to. Keeping them relative means the metadata chunk
+// can be resized without rewriting the index.
+inline uint64_t getDataOffset(const HATHeader& header) {
+    return HAT_HEADER_SIZE + header.metadataSize;
+}
+
+// Value stored under `key`, or an empty string
+const std::string& getMetadataValue(const TrackInfo& trackInfo, const std::string& key);
+
+// Starts a fine seek page, followed by `entries` block offsets.
+struct SeekPageHeader {
+    uint32_t sync;
+    uint32_t entries;
+};
+
+// Starts the coarse seek index, followed by pageCount fine page offsets.
+struct SeekIndexHeader {
+    uint32_t sync;
+    uint32_t blockCount;
+    uint32_t pageEntries;
+    uint32_t pageCount;
+};
+
+// Starts a checkpoint. It is followed by pageCount fine page offsets, the
+// offsets of the partialCount blocks not yet covered by a fine page, and a
+// CRC32 of everything from the sync word on.
+struct CheckpointHeader {
+    uint32_t sync;
+    uint32_t blockCount;
+    uint32_t pageEntries;
+    uint32_t pageCount;
+    uint32_t partialCount;
+};
+
+// Precedes every compressed block in the audio data section.
+struct BlockHeader {
+    uint32_t sync;
+    uint32_t frames;
+    uint32_t size; // Compressed payload size, including the checksum
+    uint32_t crc;  // CRC32 of the compressed payload
 };
 
+// On-disk sizes of the records above. Like the header they are packed
+// little-endian, whatever the byte order of the machine writing them.
+const size_t HAT_BLOCK_HEADER_SIZE = 16;
+const size_t HAT_PAGE_HEADER_SIZE = 8;
+const size_t HAT_INDEX_HEADER_SIZE = 16;
+const size_t HAT_CHECKPOINT_HEADER_SIZE = 20;
+
+// Reads a 4 byte little-endian value, e.g. the sync word every record starts with
+uint32_t unpackU32(const uint8_t* data);
+// Pack and unpack the fixed part of the records. Unpacking validates nothing,
+// not even the sync word.
+void packBlockHeader(const BlockHeader& blockHeader, uint8_t* out);
+void unpackBlockHeader(const uint8_t* data, BlockHeader& blockHeader);
+void unpackSeekPageHeader(const uint8_t* data, SeekPageHeader& pageHeader);
+void unpackSeekIndexHeader(const uint8_t* data, SeekIndexHeader& seekIndex);
+void unpackCheckpointHeader(const uint8_t* data, CheckpointHeader& checkpoint);
+// Unpacks `count` 8 byte offsets
+void unpackOffsets(const uint8_t* data, size_t count, uint64_t* offsets);
+// Pack a whole fine page, coarse index or checkpoint, header included
+std::vector<uint8_t> packSeekPage(const std::vector<uint64_t>& blockOffsets);
+std::vector<uint8_t> packSeekIndex(uint32_t blockCount, const std::vector<uint64_t>& pageOffsets);
+std::vector<uint8_t> packCheckpoint(uint32_t blockCount, const std::vector<uint64_t>& pageOffsets, const std::vector<uint64_t>& blockOffsets);
+
+// Packs the fixed header record into HAT_HEADER_SIZE bytes at out
+void packHATHeader(const HATHeader& header, const TrackInfo& trackInfo, uint8_t* out);
+// Unpacks HAT_HEADER_SIZE bytes. Fails, with a message, if the version is not
+// HAT_VERSION, the CRC does not match or the metadata chunk is larger than
+// HAT_MAX_METADATA_SIZE. The metadata is left untouched.
+bool unpackHATHeader(const uint8_t* data, HATHeader& header, TrackInfo& trackInfo);
+// Size of the metadata chunk without any padding, UINT32_MAX if it is larger
+uint32_t getMetadataChunkSize(const std::map<std::string, std::string>& metadata);
+// Packs the metadata chunk into `size` bytes, zero padding the rest. Fails if
+// the entries do not fit.
+bool packMetadata(const std::map<std::string, std::string>& metadata, uint8_t* out, size_t size);
+// Fails, with a message, if the chunk is malformed or its CRC does not match.
+// An empty chunk (size 0) holds no metadata.
+bool unpackMetadata(const uint8_t* data, size_t size, std::map<std::string, std::string>& metadata);
+// Packs the attachment directory, header included
+std::vector<uint8_t> packAttachmentDirectory(const std::vector<AttachmentInfo>& attachments);
+// Total size of the attachment directory whose first HAT_ATTACHMENT_HEADER_SIZE
+// bytes are at `data`, or 0 if they are not a directory header
+uint64_t getAttachmentDirectorySize(const uint8_t* data);
+// Unpacks a whole directory. Fails, with a message, if it is malformed or the
+// CRC does not match.
+bool unpackAttachmentDirectory(const uint8_t* data, size_t size, std::vector<AttachmentInfo>& attachments);
+// Packs the track directory, header included
+std::vector<uint8_t> packTrackDirectory(const std::vector<TrackDirectoryEntry>& tracks);
+// Total size of the track directory whose first HAT_TRACK_HEADER_SIZE bytes
+// are at `data`, or 0 if they are not a directory header
+uint64_t getTrackDirectorySize(const uint8_t* data);
+// Unpacks a whole directory. Fails, with a message, if it is malformed or the
+// CRC does not match.
+bool unpackTrackDirectory(const uint8_t* data, size_t size, std::vector<TrackDirectoryEntry>& tracks);
+// Read and write the header record followed by the metadata chunk
+bool readHATHeader(std::istream& input, HATHeader& header, TrackInfo& trackInfo);
+bool writeHATHeader(std::ostream& output, const HATHeader& header, const TrackInfo& trackInfo);
+
 uint16_t calculateChecksum(const std::vector<uint8_t>& data);
+uint32_t calculateCRC32(const uint8_t* data, size_t size, uint32_t crc = 0);
+// Checks the trailing 2-byte checksum of a compressed block
+bool verifyChecksum(const std::vector<uint8_t>& compressedData);
+bool verifyChecksum(const uint8_t* compressedData, size_t size);
 std::vector<uint8_t> compressData(const std::vector<int16_t>& data, float& compressionRatio);
+// Largest block compressData() can produce from `samples` samples, checksum included
+uint64_t getMaxCompressedSize(size_t samples);
 std::vector<int16_t> decompressData(const std::vector<uint8_t>& compressedData, size_t dataSize);
+// Decompresses a block in place, e.g. from a memory-mapped file. `size` includes the checksum.
+std::vector<int16_t> decompressData(const uint8_t* compressedData, size_t size, size_t dataSize);
 
 #endif
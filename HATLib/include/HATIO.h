@@ -0,0 +1,212 @@
+#ifndef HATIO_H
+#define HATIO_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <cstdint> // Ensure this is included
+
+// Where HATDecoder reads its bytes from. A source is random access: the decoder
+// reads the header, then jumps between the seek index and the blocks.
+class HATSource {
+public:
+    virtual ~HATSource() {}
+
+    virtual uint64_t size() const = 0;
+    // Copies `count` bytes starting at `offset` into dst. Fails if any of them
+    // lie past the end.
+    virtual bool readAt(uint64_t offset, void* dst, size_t count) = 0;
+
+    // Sources that hold the whole file in memory return it here, and blocks are
+    // then decompressed in place instead of being copied out first.
+    virtual const uint8_t* data() const { return nullptr; }
+    // Hints that [offset, offset + count) is about to be read out of order, or
+    // will not be read again soon. Only mapped sources act on them.
+    virtual void willNeed(uint64_t /*offset*/, uint64_t /*count*/) {}
+    virtual void release(uint64_t /*offset*/, uint64_t /*count*/) {}
+};
+
+// Bytes already in memory, such as an asset loaded from a pack file. The
+// memory is not copied and must outlive the source.
+class HATMemorySource : public HATSource {
+public:
+    HATMemorySource(const void* data, size_t size) : bytes(static_cast<const uint8_t*>(data)), byteCount(size) {}
+
+    uint64_t size() const { return byteCount; }
+    bool readAt(uint64_t offset, void* dst, size_t count);
+    const uint8_t* data() const { return bytes; }
+
+private:
+    const uint8_t* bytes;
+    size_t byteCount;
+};
+
+// A file read through std::ifstream. `offset` and `size` select a range of the
+// file, so a HAT stored inside a larger pack file can be read where it is;
+// size 0 means the rest of the file.
+class HATFileSource : public HATSource {
+public:
+    HATFileSource();
+    bool open(const std::string& filePath, uint64_t offset = 0, uint64_t size = 0);
+
+    uint64_t size() const { return byteCount; }
+    bool readAt(uint64_t offset, void* dst, size_t count);
+
+private:
+    std::ifstream stream;
+    uint64_t start;
+    uint64_t byteCount;
+};
+
+// A file, or a range of one, mapped read-only into memory. Not available on
+// Windows, where open() always fails.
+class HATMappedSource : public HATSource {
+public:
+    HATMappedSource();
+    ~HATMappedSource();
+    HATMappedSource(const HATMappedSource&) = delete;
+    HATMappedSource& operator=(const HATMappedSource&) = delete;
+    bool open(const std::string& filePath, uint64_t offset = 0, uint64_t size = 0);
+
+    uint64_t size() const { return byteCount; }
+    bool readAt(uint64_t offset, void* dst, size_t count);
+    const uint8_t* data() const { return bytes; }
+    void willNeed(uint64_t offset, uint64_t count);
+    void release(uint64_t offset, uint64_t count);
+
+private:
+    void* mapping;
+    size_t mappingSize;
+    const uint8_t* bytes; // Start of the selected range inside the mapping
+    uint64_t byteCount;
+};
+
+// Bytes supplied by the application, e.g. from its own archive reader. `read`
+// is called with an offset, destination and count and returns the number of
+// bytes it copied.
+class HATCallbackSource : public HATSource {
+public:
+    typedef std::function<size_t(uint64_t offset, void* dst, size_t count)> ReadFunction;
+    HATCallbackSource(uint64_t size, ReadFunction read) : byteCount(size), readFunction(read) {}
+
+    uint64_t size() const { return byteCount; }
+    bool readAt(uint64_t offset, void* dst, size_t count);
+
+private:
+    uint64_t byteCount;
+    ReadFunction readFunction;
+};
+
+// A range of another source, such as one track of a multi-track file. The
+// parent is not owned and must outlive the range.
+class HATRangeSource : public HATSource {
+public:
+    HATRangeSource(HATSource& parent, uint64_t offset, uint64_t size) : parent(parent), start(offset), byteCount(size) {}
+
+    uint64_t size() const { return byteCount; }
+    bool readAt(uint64_t offset, void* dst, size_t count);
+    const uint8_t* data() const { return parent.data() ? parent.data() + start : nullptr; }
+    void willNeed(uint64_t offset, uint64_t count) { parent.willNeed(start + offset, count); }
+    void release(uint64_t offset, uint64_t count) { parent.release(start + offset, count); }
+
+private:
+    HATSource& parent;
+    uint64_t start;
+    uint64_t byteCount;
+};
+
+// Opens a file with the cheapest source the platform offers: mapped where
+// possible, otherwise read through a stream. Returns null if the file cannot
+// be opened.
+std::unique_ptr<HATSource> openHATSource(const std::string& filePath, uint64_t offset = 0, uint64_t size = 0);
+
+// Where HATStreamEncoder writes its bytes. Writes are sequential except for
+// writeAt(), which finalize() uses to patch the header once the length is known.
+class HATSink {
+public:
+    virtual ~HATSink() {}
+
+    virtual bool write(const void* data, size_t count) = 0;
+    // Overwrites bytes that were already written
+    virtual bool writeAt(uint64_t offset, const void* data, size_t count) = 0;
+    // Number of bytes written so far, which is also where the next write lands
+    virtual uint64_t tell() const = 0;
+    // Pushes everything written so far to durable storage. Called at every
+    // checkpoint when the encoder has a sync interval.
+    virtual bool sync() { return true; }
+    virtual bool close() { return true; }
+};
+
+// Collects the encoded file in memory
+class HATMemorySink : public HATSink {
+public:
+    bool write(const void* data, size_t count);
+    bool writeAt(uint64_t offset, const void* data, size_t count);
+    uint64_t tell() const { return bytes.size(); }
+
+    const std::vector<uint8_t>& getData() const { return bytes; }
+
+private:
+    std::vector<uint8_t> bytes;
+};
+
+// Writes to a file through std::ofstream. sync() also fsyncs the file where
+// the platform supports it.
+class HATFileSink : public HATSink {
+public:
+    HATFileSink();
+    ~HATFileSink();
+    HATFileSink(const HATFileSink&) = delete;
+    HATFileSink& operator=(const HATFileSink&) = delete;
+    bool open(const std::string& filePath);
+
+    bool write(const void* data, size_t count);
+    bool writeAt(uint64_t offset, const void* data, size_t count);
+    uint64_t tell() const { return position; }
+    bool sync();
+    bool close();
+
+private:
+    std::string filePath;
+    std::ofstream stream;
+    uint64_t position;
+    int syncFd; // Second descriptor on the file, opened by the first sync()
+};
+
+// Hands the encoded bytes to the application. `write` is called with the
+// offset the bytes belong at, which is the running total for every call
+// except the final header patch.
+class HATCallbackSink : public HATSink {
+public:
+    typedef std::function<bool(uint64_t offset, const void* data, size_t count)> WriteFunction;
+    explicit HATCallbackSink(WriteFunction write) : writeFunction(write), position(0) {}
+
+    bool write(const void* data, size_t count);
+    bool writeAt(uint64_t offset, const void* data, size_t count);
+    uint64_t tell() const { return position; }
+
+private:
+    WriteFunction writeFunction;
+    uint64_t position;
+};
+
+// Writes into another sink starting at its current end, so an encoder can
+// write one track of a multi-track file as if it were a file of its own.
+// Offsets are relative to where the range starts; close() leaves the parent open.
+class HATRangeSink : public HATSink {
+public:
+    explicit HATRangeSink(HATSink& parent) : parent(parent), start(parent.tell()) {}
+
+    bool write(const void* data, size_t count) { return parent.write(data, count); }
+    bool writeAt(uint64_t offset, const void* data, size_t count) { return parent.writeAt(start + offset, data, count); }
+    uint64_t tell() const { return parent.tell() - start; }
+    bool sync() { return parent.sync(); }
+
+private:
+    HATSink& parent;
+    uint64_t start;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef HATMIX_H
+#define HATMIX_H
+
+#include <cstddef>
+#include <cstdint> // Ensure this is included
+
+// Mixing kernels. Sources are summed into a float accumulator, so any number
+// of them can be added before the result is clipped once on the way out.
+// SSE2 is used where the compiler targets it, plain loops elsewhere.
+
+// acc[i] += src[i] * gain
+void mixAccumulate(float* acc, const int16_t* src, size_t count, float gain);
+// dst[i] = acc[i], rounded and clipped to the int16 range
+void mixStore(int16_t* dst, const float* acc, size_t count);
+
+// Inverse distance attenuation of a source at (x, y, z)
+float calculateVolume(float x, float y, float z);
+// Left/right balance of a source at x, from -1 to 1
+float calculatePanning(float x);
+
+// Gains of one playing source on the output channels. The first two output
+// channels are left and right; any others get the attenuated level unpanned.
+// The square roots are only recomputed when the source actually moves, and
+// mix() ramps from the gains it used last time to the new ones across the
+// buffer, so a moving source does not click.
+class HATSourceGain {
+public:
+    HATSourceGain();
+
+    void setPosition(float x, float y, float z);
+    // Scales the source on top of its distance attenuation
+    void setGain(float gain);
+    // Jumps to the target gains without a ramp, e.g. when a source starts
+    void snap();
+
+    // Attenuated level the source is heading for
+    float getLevel() const { return target[2]; }
+
+    // acc += src with the source's gains. src holds `frames` interleaved frames
+    // of `channels` channels, acc the same number of `outChannels` frames.
+    // Surplus source channels are folded onto the output channels and a
+    // narrower source is repeated across them.
+    void mix(float* acc, size_t outChannels, const int16_t* src, size_t channels, size_t frames);
+
+private:
+    float position[3];
+    float gain;
+    float target[3];  // Left, right and unpanned gain
+    float current[3]; // Gains reached at the end of the last mix()
+
+    void update();
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef HATMIXER_H
+#define HATMIXER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <cstdint> // Ensure this is included
+#include "HATDecode.h"
+#include "HATRingBuffer.h"
+#include "HATMix.h"
+#include "HATResampler.h"
+
+// Identifies a voice started by HATMixer::play(). Once the voice has finished
+// its handle goes stale and is ignored, so handles are safe to hold on to.
+typedef uint64_t HATVoice;
+const HATVoice HAT_INVALID_VOICE = 0;
+// Default level below which a voice goes virtual, about -60 dB
+const float HAT_VIRTUAL_THRESHOLD = 0.001f;
+
+// Mixing engine for many sources playing at once, such as game sound effects.
+// All voices come from a pool allocated up front. One decode thread keeps a
+// small ring buffer per playing voice topped up a block at a time, and mix(),
+// called from the audio device callback, sums the voices into a float bus
+// with their spatial gains and converts the bus to int16 once. mix() never
+// allocates, locks or does I/O, and its cost grows with the number of playing
+// voices, not with the length of their files. Files at any sample rate can
+// play together; each voice is resampled to the mixer's rate as it is mixed.
+//
+// A voice whose attenuated level (see calculateVolume()) drops below the
+// virtual threshold goes virtual: its play position keeps moving but nothing
+// is decoded or mixed for it. When it becomes audible again the decode thread
+// seeks to where it would have been, so it resumes on the right frame. Far
+// more voices can exist than are ever heard at once.
+//
+// play(), stop() and the setters are meant to be called from one control
+// thread and mix() from the audio thread. Stop the audio device before
+// destroying the mixer.
+class HATMixer {
+public:
+    // Voices at other sample rates are converted to `sampleRate` with a
+    // resampler of the given quality
+    HATMixer(uint32_t maxVoices, int sampleRate, int outChannels, ResampleQuality quality = RESAMPLE_MEDIUM);
+    ~HATMixer();
+    HATMixer(const HATMixer&) = delete;
+    HATMixer& operator=(const HATMixer&) = delete;
+
+    // Starts a file playing at (x, y, z). Unless the voice starts out virtual,
+    // its first block is decoded before this returns, so it is heard in the
+    // next callback. Returns
+    // HAT_INVALID_VOICE if the file cannot be played or every voice is in use.
+    HATVoice play(const std::string& inputFilePath, float x, float y, float z, float gain = 1.0f, bool loop = false);
+    // Plays a decoder, e.g. one seeked or switched to another track, from its
+    // current position. It is opened first if it is not open yet. A looping
+    // voice restarts from the beginning of its track.
+    HATVoice play(std::unique_ptr<HATDecoder> decoder, float x, float y, float z, float gain = 1.0f, bool loop = false);
+    void stop(HATVoice voice);
+    void setPosition(HATVoice voice, float x, float y, float z);
+    void setGain(HATVoice voice, float gain);
+    void setPaused(HATVoice voice, bool paused);
+    // False once the voice has finished or been stopped
+    bool isPlaying(HATVoice voice) const;
+    // Level below which a voice goes virtual. Defaults to HAT_VIRTUAL_THRESHOLD;
+    // 0 keeps every voice real.
+    void setVirtualThreshold(float level) { virtualThreshold.store(level); }
+
+    // Audio thread. Writes `frames` interleaved frames of the mix to output.
+    void mix(int16_t* output, size_t frames);
+
+    int getSampleRate() const { return sampleRate; }
+    int getChannels() const { return outChannels; }
+    uint32_t getMaxVoices() const { return static_cast<uint32_t>(voices.size()); }
+    // Playing voices, virtual ones included
+    uint32_t getActiveVoices() const;
+    uint32_t getVirtualVoices() const;
+    // Times a playing voice ran out of decoded audio
+    uint64_t getUnderruns() const { return underruns.load(); }
+
+private:
+    // FREE -> STARTING (play) -> PLAYING -> RELEASING (mix, when the voice
+    // ends or is stopped) -> FREE (decode thread, which drops the decoder)
+    enum VoiceState { VOICE_FREE, VOICE_STARTING, VOICE_PLAYING, VOICE_RELEASING };
+
+    struct Voice {
+        std::atomic<int> state;
+        std::atomic<uint32_t> generation;
+        std::unique_ptr<HATDecoder> decoder;
+        std::unique_ptr<HATRingBuffer<int16_t>> ring;
+        std::vector<int16_t> buffer; // Frames taken from the ring by mix()
+        size_t channels;
+        bool loop;
+        HATSourceGain gain;          // Only touched by mix() once playing
+
+        // Set by the control thread, picked up by mix()
+        std::atomic<float> position[3];
+        std::atomic<float> level;
+        std::atomic<bool> paused;
+        std::atomic<bool> stopRequested;
+        // Set by the decode thread after its last write
+        std::atomic<bool> decodeFinished;
+
+        // Play position in frames of the track, kept by mix() even while the
+        // voice is virtual
+        uint64_t cursor;
+        uint64_t frameCount;
+        bool isVirtual;
+        std::atomic<bool> virtualFlag; // isVirtual, for the decode thread
+
+        // Resuming a virtual voice. mix() asks for a seek to resumeFrame by
+        // bumping seekRequest; the decode thread seeks, records how many
+        // samples it had written by then in segmentStart and sets seekServed.
+        // mix() then drops everything before segmentStart and skips the frames
+        // that played while the decode thread was seeking.
+        std::atomic<uint64_t> seekFrame;
+        std::atomic<uint32_t> seekRequest;
+        std::atomic<uint32_t> seekServed;
+        std::atomic<uint64_t> segmentStart;
+        uint64_t samplesWritten; // Decode thread
+        uint64_t samplesRead;    // mix()
+        uint64_t resumeFrame;
+        uint64_t skipFrames;
+        bool resyncing;
+
+        // Used by mix() when the file's sample rate is not the mixer's
+        HATResampler resampler;
+        std::vector<int16_t> resampled;
+        bool resampling;
+        size_t tailPadding; // Frames of silence still to feed in after the end of the track
+
+        Voice();
+    };
+
+    std::vector<std::unique_ptr<Voice>> voices;
+    std::vector<float> bus;
+    std::vector<int16_t> decodeBlock; // Decode thread scratch
+    int sampleRate;
+    int outChannels;
+    ResampleQuality quality;
+    std::atomic<uint64_t> underruns;
+    std::atomic<float> virtualThreshold;
+    std::atomic<bool> running;
+    std::thread decodeThread;
+
+    Voice* findVoice(HATVoice voice) const;
+    bool fillVoice(Voice& voice, std::vector<int16_t>& block);
+    void mixVoice(Voice& voice, size_t frames);
+    void mixResampled(Voice& voice, size_t frames);
+    bool catchUp(Voice& voice, size_t frames);
+    void advanceVoice(Voice& voice, size_t frames);
+    void decodeLoop();
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef HATMULTITRACKENCODE_H
+#define HATMULTITRACKENCODE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint> // Ensure this is included
+#include "HATFormat.h"
+#include "HATIO.h"
+#include "HATStreamEncode.h"
+
+// Writes a file holding several tracks, such as stems or dubs in different
+// languages. The tracks are encoded one after the other, each by its own
+// HATStreamEncoder, and the track directory at the front of the file is
+// patched by finalize(). Memory use is that of encoding a single track.
+class HATMultiTrackEncoder {
+public:
+    // `metadata` describes the file as a whole, e.g. the album or film title
+    HATMultiTrackEncoder(const std::string& outputFilePath, uint32_t trackCount, const std::unordered_map<std::string, std::string>& metadata);
+    // Encodes into any byte sink. The sink is not owned and must outlive the encoder.
+    HATMultiTrackEncoder(HATSink& sink, uint32_t trackCount, const std::unordered_map<std::string, std::string>& metadata);
+    HATMultiTrackEncoder(const HATMultiTrackEncoder&) = delete;
+    HATMultiTrackEncoder& operator=(const HATMultiTrackEncoder&) = delete;
+
+    // Completes the previous track and starts the next one. Write its audio
+    // through the returned encoder, which stays valid until the next
+    // addTrack() or finalize(). Returns null once all tracks have been added
+    // or if the file cannot be written.
+    HATStreamEncoder* addTrack(int sampleRate, int bitRate, int audioChannels, const std::unordered_map<std::string, std::string>& metadata);
+    // Completes the last track and writes the track directory. Fails if fewer
+    // tracks were added than the file was created for.
+    bool finalize();
+
+    uint32_t getTrackCount() const { return trackCount; }
+
+private:
+    std::string outputFilePath;
+    std::unique_ptr<HATFileSink> ownedSink; // Used when constructed with a path
+    HATSink* sink;
+    HATHeader header;
+    TrackInfo trackInfo;
+    uint32_t trackCount;
+
+    std::vector<TrackDirectoryEntry> tracks;
+    std::unique_ptr<HATRangeSink> trackSink;
+    std::unique_ptr<HATStreamEncoder> trackEncoder;
+    bool isOpen;
+    bool finalized;
+
+    bool open();
+    bool endTrack();
+    bool writeHeaders(bool patch);
+};
+
+#endif
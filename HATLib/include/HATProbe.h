@@ -0,0 +1,49 @@
+#ifndef HATPROBE_H
+#define HATPROBE_H
+
+#include <string>
+#include <vector>
+#include <cstdint> // Ensure this is included
+#include "HATFormat.h"
+#include "HATIO.h"
+
+// Reads just the header and metadata of a HAT file, normally in a single small
+// read, without touching the audio, seek index or decompressor. Meant for
+// listing and indexing large catalogs. A probe can be reused for many files.
+class HATProbe {
+public:
+    HATProbe();
+
+    // Returns false if the file cannot be read or its header is not valid
+    bool open(const std::string& filePath);
+    bool open(HATSource& source);
+
+    const HATHeader& getHeader() const { return header; }
+    const TrackInfo& getTrackInfo() const { return trackInfo; }
+
+    uint64_t getFrameCount() const { return header.channels ? header.length / header.channels : 0; }
+    double getDuration() const { return header.sampleRate ? static_cast<double>(getFrameCount()) / header.sampleRate : 0.0; }
+    int getSampleRate() const { return header.sampleRate; }
+    int getBitRate() const { return header.bitRate; }
+    int getChannels() const { return header.channels; }
+    int getTracks() const { return header.tracks; }
+    CompressionMethod getCompressionMethod() const { return header.compressionMethod; }
+    float getCompressionRatio() const { return header.compressionRatio; }
+    const std::string& getVersion() const { return header.version; }
+    const float* getSpatialData() const { return header.spatialData; }
+    const std::string& getArtist() const { return getMetadataValue(trackInfo, "artist"); }
+    const std::string& getDescription() const { return getMetadataValue(trackInfo, "description"); }
+    const std::string& getTrackName() const { return getMetadataValue(trackInfo, "trackName"); }
+    const std::map<std::string, std::string>& getMetadata() const { return trackInfo.metadata; }
+    int getTrackNumber() const { return trackInfo.trackNumber; }
+    bool hasAttachments() const { return header.attachmentDirectory != 0; }
+
+private:
+    HATHeader header;
+    TrackInfo trackInfo;
+    std::vector<uint8_t> buffer;
+
+    bool parseHeader();
+};
+
+#endif
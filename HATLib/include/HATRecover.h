@@ -0,0 +1,16 @@
+#ifndef HATRECOVER_H
+#define HATRECOVER_H
+
+#include <string>
+
+// Repairs a HAT file whose writer stopped before HATStreamEncoder::finalize(),
+// such as a live recording cut short by a crash or power loss. The last intact
+// checkpoint is located by scanning back from the end of the file, the blocks
+// written after it are validated by their sync words and CRCs, and the damaged
+// tail is replaced by a fresh seek index and header. The work done is
+// proportional to the part of the file written after the last checkpoint.
+//
+// Returns true if the file is complete afterwards, including when it already was.
+bool recoverHATFile(const std::string& filePath);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef HATRESAMPLER_H
+#define HATRESAMPLER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint> // Ensure this is included
+
+enum ResampleQuality {
+    RESAMPLE_FAST,   // 8 taps per phase
+    RESAMPLE_MEDIUM, // 16 taps per phase
+    RESAMPLE_BEST    // 32 taps per phase
+};
+
+// Windowed-sinc polyphase sample rate converter. The Kaiser-windowed filter
+// for every phase is computed once by setup(), so converting is a dot product
+// per output sample, done four taps at a time with SSE2 where available. When
+// downsampling, the filter is widened to cut off at the output's Nyquist
+// frequency. Ratios of standard rates (44100 to 48000 is 160/147) get a table
+// per phase; rates with no small ratio use the nearest of 1024 phases.
+//
+// Input is pushed with write() and output pulled with read(), so the
+// converter can sit between a ring buffer and a mixer. Input and output
+// frames are interleaved int16; the resampler keeps its history in float.
+class HATResampler {
+public:
+    HATResampler();
+
+    // Allocates the tables and history. Converting at most `maxFrames` frames
+    // per write() or read() call never allocates afterwards.
+    void setup(int inputRate, int outputRate, int channels, ResampleQuality quality, size_t maxFrames);
+    // Drops the buffered input but keeps the fractional position, e.g. after
+    // seeking the source
+    void reset();
+
+    // Input frames to write() before read() can produce `frames` more frames
+    size_t getInputNeeded(size_t frames) const;
+    // Free space for input, in frames
+    size_t getSpace() const { return historySize - historyFrames; }
+    // Input frames buffered ahead of the current output position
+    size_t getBufferedFrames() const;
+    size_t getTaps() const { return taps; }
+
+    // Adds up to `frames` input frames and returns how many fit
+    size_t write(const int16_t* input, size_t frames);
+    // Produces up to `frames` output frames from the buffered input. Returns
+    // the number produced, short when more input is needed.
+    size_t read(int16_t* output, size_t frames);
+    // Moves on by `frames` output frames without any input, keeping the
+    // fractional position, e.g. while a voice is virtual. The buffered input
+    // is dropped. Returns the number of input frames passed over.
+    uint64_t advance(uint64_t frames);
+
+private:
+    size_t channels;
+    size_t taps;
+    uint32_t upFactor;   // Output rate / input rate is upFactor / downFactor
+    uint32_t downFactor;
+    uint32_t phases;     // Filter tables, upFactor of them or fewer
+    uint64_t phaseScale; // phases / upFactor in 32.32 fixed point
+    uint32_t phase;      // Position between two input frames, in 1/upFactor
+    std::vector<float> filters;
+    std::vector<float> history; // One run of historySize frames per channel
+    size_t historySize;
+    size_t historyFrames;
+    size_t historyStart;        // First input frame of the next output's window
+    std::vector<float> output;  // Interleaved output before conversion to int16
+};
+
+#endif
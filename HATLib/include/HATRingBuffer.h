@@ -0,0 +1,90 @@
+#ifndef HATRINGBUFFER_H
+#define HATRINGBUFFER_H
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
+
+// Wait-free single-producer/single-consumer ring buffer for handing audio
+// between a real-time callback and a worker thread. All memory is allocated in
+// the constructor; write() and read() never allocate, lock or block, so either
+// side may run on an audio thread. Exactly one thread may call write() and
+// exactly one other thread may call read().
+template <typename T>
+class HATRingBuffer {
+public:
+    // Capacity is rounded up to a power of two.
+    explicit HATRingBuffer(size_t capacity) : head(0), tail(0) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        buffer.resize(size);
+        mask = size - 1;
+    }
+
+    size_t capacity() const { return buffer.size(); }
+
+    // Number of items the consumer can read.
+    size_t available() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    // Number of items the producer can write.
+    size_t space() const {
+        return buffer.size() - available();
+    }
+
+    // Producer side. Copies up to `count` items in and returns how many fit.
+    size_t write(const T* data, size_t count) {
+        size_t writePos = head.load(std::memory_order_relaxed);
+        size_t readPos = tail.load(std::memory_order_acquire);
+        count = std::min(count, buffer.size() - (writePos - readPos));
+
+        size_t start = writePos & mask;
+        size_t first = std::min(count, buffer.size() - start);
+        std::copy(data, data + first, buffer.begin() + start);
+        std::copy(data + first, data + count, buffer.begin());
+
+        head.store(writePos + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side. Copies up to `count` items out and returns how many were read.
+    size_t read(T* data, size_t count) {
+        size_t readPos = tail.load(std::memory_order_relaxed);
+        size_t writePos = head.load(std::memory_order_acquire);
+        count = std::min(count, writePos - readPos);
+
+        size_t start = readPos & mask;
+        size_t first = std::min(count, buffer.size() - start);
+        std::copy(buffer.begin() + start, buffer.begin() + start + first, data);
+        std::copy(buffer.begin(), buffer.begin() + (count - first), data + first);
+
+        tail.store(readPos + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side. Drops everything currently buffered.
+    void clear() {
+        tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+private:
+    // Assumed cache line size. head and tail are kept a whole line apart, and
+    // apart from the fields both sides read, so producer and consumer do not
+    // contend. Padding rather than alignas keeps this true when the buffer is
+    // allocated with new, which before C++17 ignores over-alignment.
+    static const size_t CACHE_LINE = 64;
+
+    std::vector<T> buffer;
+    size_t mask;
+    char headPadding[CACHE_LINE];
+    std::atomic<size_t> head; // Advanced only by the producer
+    char tailPadding[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail; // Advanced only by the consumer
+    char endPadding[CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+#endif
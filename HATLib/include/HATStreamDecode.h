@@ -0,0 +1,71 @@
+#ifndef HATSTREAMDECODE_H
+#define HATSTREAMDECODE_H
+
+#include <string>
+#include <vector>
+#include <cstdint> // Ensure this is included
+#include "HATFormat.h"
+
+// Incremental decoder for HAT data that arrives in arbitrary chunks, e.g. from
+// a pipe or socket that cannot seek. Bytes are pushed in with feed() and every
+// block is decoded as soon as its last byte arrives. At most one block is
+// buffered internally. Of a multi-track file, the first track is decoded.
+class HATStreamDecoder {
+public:
+    HATStreamDecoder();
+
+    // Consumes `size` bytes and returns the interleaved frames of every block
+    // completed by them. The returned buffer is reused by the next call.
+    const std::vector<int16_t>& feed(const uint8_t* data, size_t size);
+
+    // True once a valid header and its metadata have been read, even if the
+    // stream failed later
+    bool hasHeader() const { return headerRead; }
+    bool isFinished() const { return state == STREAM_END; }
+    bool hasError() const { return state == STREAM_ERROR; }
+    uint64_t getFramesDecoded() const { return framesDecoded; }
+
+    int getSampleRate() const { return header.sampleRate; }
+    int getBitRate() const { return header.bitRate; }
+    int getChannels() const { return header.channels; }
+    int getTracks() const { return header.tracks; }
+    const std::string& getVersion() const { return header.version; }
+    const float* getSpatialData() const { return header.spatialData; }
+    const std::string& getArtist() const { return getMetadataValue(trackInfo, "artist"); }
+    const std::string& getDescription() const { return getMetadataValue(trackInfo, "description"); }
+    const std::string& getTrackName() const { return getMetadataValue(trackInfo, "trackName"); }
+    const std::map<std::string, std::string>& getMetadata() const { return trackInfo.metadata; }
+    int getTrackNumber() const { return trackInfo.trackNumber; }
+
+private:
+    enum StreamState {
+        STREAM_HEADER,       // Waiting for the fixed header
+        STREAM_METADATA,     // Waiting for the metadata chunk
+        STREAM_SYNC,         // Waiting for the sync word of the next block or seek page
+        STREAM_BLOCK_HEADER, // Waiting for the rest of a block header
+        STREAM_BLOCK,        // Waiting for the rest of a block payload
+        STREAM_PAGE_HEADER,  // Waiting for the entry count of a fine seek page
+        STREAM_CHECKPOINT,   // Waiting for the rest of a checkpoint header
+        STREAM_TRACK_HEADER, // Waiting for the rest of a track directory header
+        STREAM_TRACKS,       // Waiting for the entries of a track directory
+        STREAM_SKIP,         // Skipping the entries of a fine seek page or checkpoint, or up to a track
+        STREAM_END,          // Reached the coarse seek index after the last block
+        STREAM_ERROR
+    };
+
+    StreamState state;
+    HATHeader header;
+    TrackInfo trackInfo;
+    BlockHeader blockHeader;
+    std::vector<uint8_t> pending; // Bytes of the unit currently being assembled
+    size_t pendingSize;           // Size that unit is complete at
+    uint64_t skipRemaining;
+    StreamState afterSkip;
+    std::vector<int16_t> output;
+    uint64_t framesDecoded;
+    bool headerRead;
+
+    void processPending();
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef HATSTREAMENCODE_H
+#define HATSTREAMENCODE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint> // Ensure this is included
+#include "HATFormat.h"
+#include "HATIO.h"
+
+// Encoder that takes audio a piece at a time. Every block is compressed and
+// written as soon as it fills, and fine seek pages are written between the
+// blocks as they fill, so memory use is about one block regardless of how much
+// audio is written. finalize() writes the coarse seek index and patches the
+// header with the final length.
+//
+// For live recording, setSyncInterval() makes the encoder write a checkpoint
+// and fsync the file every few blocks. If the process dies before finalize(),
+// recoverHATFile() turns what reached the disk into a playable file.
+class HATStreamEncoder {
+public:
+    HATStreamEncoder(const std::string& outputFilePath, int sampleRate, int bitRate, int audioChannels, const std::unordered_map<std::string, std::string>& metadata);
+    // Encodes into any byte sink, e.g. a HATMemorySink. The sink is not owned
+    // and must outlive the encoder.
+    HATStreamEncoder(HATSink& sink, int sampleRate, int bitRate, int audioChannels, const std::unordered_map<std::string, std::string>& metadata);
+
+    // Writes a checkpoint and syncs the file to disk every `blocks` blocks.
+    // 0 (the default) disables both. Must be called before open().
+    void setSyncInterval(uint32_t blocks) { syncInterval = blocks; }
+    // Free bytes reserved after the metadata so it can later be edited in
+    // place. Defaults to HAT_METADATA_PADDING. Must be called before open().
+    void setMetadataPadding(uint32_t bytes) { metadataPadding = bytes; }
+    // Number of this track within a multi-track file. Defaults to 1. Must be
+    // called before open().
+    void setTrackNumber(int number) { trackInfo.trackNumber = number; }
+
+    // Adds an attachment such as cover art or lyrics, which finalize() writes
+    // after the audio. The data is copied. Returns the attachment's id.
+    uint32_t addAttachment(const std::string& name, const std::string& mimeType, const std::vector<uint8_t>& data);
+
+    // Creates the output file, when constructed with a path, and writes a
+    // placeholder header. write() calls this itself if needed.
+    bool open();
+    // Appends `frames` interleaved frames.
+    bool write(const int16_t* data, size_t frames);
+    // Flushes the last partial block and completes the file.
+    bool finalize();
+
+    uint64_t getFramesWritten() const { return framesWritten; }
+    uint64_t getCompressedSize() const { return compressedSize; }
+    float getCompressionRatio() const { return header.compressionRatio; }
+
+private:
+    std::string outputFilePath;
+    std::unique_ptr<HATFileSink> ownedSink; // Used when constructed with a path
+    HATSink* sink;
+    HATHeader header;
+    TrackInfo trackInfo;
+
+    std::vector<int16_t> blockData;    // Samples of the block being filled
+    std::vector<uint64_t> pageOffsets; // Block offsets for the fine page being filled
+    std::vector<uint64_t> coarseIndex;
+    std::vector<AttachmentInfo> attachments;
+    std::vector<std::vector<uint8_t>> attachmentData;
+    uint64_t framesWritten;
+    uint64_t compressedSize;
+    uint64_t blockCount;
+    uint32_t syncInterval;
+    uint32_t metadataPadding;
+    uint32_t blocksSinceSync;
+    bool isOpen;
+    bool finalized;
+
+    bool flushBlock();
+    bool flushPage();
+    bool writeCheckpoint();
+    bool writeAttachments();
+    bool syncToDisk();
+    bool writeHeaders(bool patch);
+};
+
+#endif
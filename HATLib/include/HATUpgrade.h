@@ -0,0 +1,17 @@
+#ifndef HATUPGRADE_H
+#define HATUPGRADE_H
+
+#include <string>
+
+// Converts a file written by HAT 1.0 to the current format. Version 1.0 had a
+// fixed 818 byte header with 256 byte text fields and stored the whole track
+// as a single compressed stream, with no blocks or seek index; the current
+// readers reject it. The audio is decoded in memory, checked against its
+// checksum and length, and encoded again into `outputFilePath`, keeping the
+// artist, description, track name and track number.
+//
+// Returns false, with a message, if the input is not an intact 1.0 file or
+// the output cannot be written. The input is never modified.
+bool upgradeHATFile(const std::string& inputFilePath, const std::string& outputFilePath);
+
+#endif
@@ -1,134 +1,554 @@
 #include "HATDecode.h"
-#include <fstream>
 #include <iostream>
 #include <numeric>
+#include <algorithm>
+#include <cstring>
 #include "HATFormat.h"
+#include "HATMix.h"
 
 HATDecoder::HATDecoder(const std::string& inputFilePath)
-    : inputFilePath(inputFilePath) {}
+    : inputFilePath(inputFilePath), header(), trackInfo(), fileSource(nullptr), source(nullptr), trackIndex(0), trackCount(0), seekIndex(), finePageIndex(UINT64_MAX), blockIndex(UINT64_MAX), position(0), indexLoaded(false), attachmentDirectoryEnd(0), attachmentsLoaded(false), mixPosition(0), mixFrameCount(0) {}
+
+HATDecoder::HATDecoder(HATSource& source)
+    : header(), trackInfo(), fileSource(&source), source(nullptr), trackIndex(0), trackCount(0), seekIndex(), finePageIndex(UINT64_MAX), blockIndex(UINT64_MAX), position(0), indexLoaded(false), attachmentDirectoryEnd(0), attachmentsLoaded(false), mixPosition(0), mixFrameCount(0) {}
 
 void HATDecoder::decode() {
-    std::ifstream inputFile(inputFilePath, std::ios::binary | std::ios::ate);
-    if (!inputFile.is_open()) {
-        std::cerr << "\033[31m Error opening input file." << std::endl << "\033[39m";
+    if (!open()) {
         return;
     }
 
-    std::streamsize fileSize = inputFile.tellg();
-    inputFile.seekg(0, std::ios::beg);
+    audioData.resize(static_cast<size_t>(getFrameCount()) * header.channels);
+    audioData.resize(read(audioData.data(), static_cast<size_t>(getFrameCount())) * header.channels);
 
-    readHATHeader(inputFile, header);
-    readTrackInfo(inputFile, trackInfo);
+    if (header.length != audioData.size()) {
+        std::cerr << "\033[31m Decompression failed! Size mismatch. Expected: " << header.length << ", Got: " << audioData.size() << std::endl << "\033[39m";
+    } else {
+        std::cout << "\033[32m Decompression successful. Decompressed data size matches the expected size.\033[39m" << std::endl;
+    }
 
-    std::vector<uint8_t> compressedData(header.datalength);  // Use datalength to read compressed data
-    inputFile.read(reinterpret_cast<char*>(compressedData.data()), compressedData.size());
+    // The coarse seek index (header plus one offset per fine page) closes the
+    // file, unless attachments follow it
+    uint64_t expectedSize = getDataOffset(header) + trackInfo.seekMarker + HAT_INDEX_HEADER_SIZE + seekIndex.pageCount * sizeof(uint64_t);
+    if (header.attachmentDirectory != 0 && loadAttachments()) {
+        expectedSize = attachmentDirectoryEnd;
+    }
+    std::cout << "File size: \033[32m" << source->size() << "\033[39m bytes, Expected total data size (including headers): \033[32m" << expectedSize << " \033[39mbytes" << std::endl;
+    if (source->size() != expectedSize) {
+        std::cerr << "\033[93m File size mismatch! The entire file size does not match the expected total data size." << std::endl << "\033[39m";
+    }
+}
 
-    // Verify checksum before decompression
-    uint16_t storedChecksum = static_cast<uint16_t>(compressedData[compressedData.size() - 2]) |
-                              (static_cast<uint16_t>(compressedData[compressedData.size() - 1]) << 8);
-    compressedData.resize(compressedData.size() - 2);
+bool HATDecoder::seek(uint64_t frame) {
+    if (!indexLoaded && !open()) {
+        return false;
+    }
 
-    uint16_t calculatedChecksum = std::accumulate(compressedData.begin(), compressedData.end(), 0u);
-    if (storedChecksum != calculatedChecksum) {
-        std::cerr << "\033[31m Checksum mismatch! Data may be corrupted." << std::endl << "\033[39m";
-        return;
+    if (frame > getFrameCount()) {
+        std::cerr << "\033[31m Seek position " << frame << " is past the end of the track (" << getFrameCount() << " frames)." << std::endl << "\033[39m";
+        return false;
     }
 
-    audioData = decompressData(compressedData, header.length);
+    position = frame;
+    if (frame < getFrameCount()) {
+        uint64_t index = frame / header.blockFrames;
+        if (index != blockIndex && !loadBlock(index, true)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    inputFile.close();
+size_t HATDecoder::read(int16_t* dst, size_t frames) {
+    if (!indexLoaded && !open()) {
+        return 0;
+    }
 
-    if (header.length != audioData.size()) {
-        std::cerr << "\033[31m Decompression failed! Size mismatch. Expected: " << header.length << ", Got: " << audioData.size() << std::endl << "\033[39m";
-    } else {
-        std::cout << "\033[32m Decompression successful. Decompressed data size matches the expected size.\033[39m" << std::endl;
+    size_t channels = header.channels;
+    size_t framesRead = 0;
+    while (framesRead < frames && position < getFrameCount()) {
+        uint64_t index = position / header.blockFrames;
+        if (index != blockIndex && !loadBlock(index, false)) {
+            break;
+        }
+
+        size_t offset = static_cast<size_t>(position - index * header.blockFrames);
+        if (offset >= blockData.size() / channels) {
+            std::cerr << "\033[31m Block " << index << " is shorter than the track says! Data may be corrupted." << std::endl << "\033[39m";
+            break;
+        }
+        size_t count = std::min(frames - framesRead, blockData.size() / channels - offset);
+        std::copy(blockData.begin() + offset * channels, blockData.begin() + (offset + count) * channels, dst + framesRead * channels);
+
+        framesRead += count;
+        position += count;
     }
+    return framesRead;
+}
 
-    std::cout << "File size: \033[32m" << fileSize << "\033[39m bytes, Expected total data size (including headers): \033[32m" << (header.datalength + sizeof(HATHeader) + sizeof(TrackInfo) + 4) << " \033[39mbytes" << std::endl;
-    if (fileSize != (header.datalength + sizeof(HATHeader) + sizeof(TrackInfo) + 4)) {
-        std::cerr << "\033[93m File size mismatch! The entire file size does not match the expected total data size." << std::endl << "\033[39m";
+size_t HATDecoder::decodeRange(uint64_t firstFrame, uint64_t frameCount, int16_t* out) {
+    uint64_t savedPosition = position;
+    size_t framesRead = 0;
+    if (seek(firstFrame)) {
+        framesRead = read(out, static_cast<size_t>(frameCount));
+    }
+    position = savedPosition;
+    return framesRead;
+}
+
+bool HATDecoder::open() {
+    if (!fileSource) {
+        // Mapped where the platform allows it, so blocks decompress straight from the page cache
+        ownedSource = openHATSource(inputFilePath);
+        fileSource = ownedSource.get();
+    }
+    if (!fileSource) {
+        std::cerr << "\033[31m Error opening input file." << std::endl << "\033[39m";
+        return false;
+    }
+
+    indexLoaded = false;
+    source = fileSource;
+    trackSource.reset();
+    trackCount = 1;
+    if (!readHeader()) {
+        return false;
+    }
+
+    // A multi-track file has its track directory where the audio would start
+    uint8_t directoryHeader[HAT_TRACK_HEADER_SIZE];
+    if (source->readAt(getDataOffset(header), directoryHeader, sizeof(directoryHeader)) && getTrackDirectorySize(directoryHeader) != 0) {
+        if (!openTrack(directoryHeader)) {
+            return false;
+        }
+    } else if (trackIndex != 0) {
+        std::cerr << "\033[31m Track " << trackIndex << " does not exist; the file has a single track." << std::endl << "\033[39m";
+        return false;
     }
+
+    // Only the coarse level is read here; fine pages are fetched by findBlock()
+    finePage.clear();
+    finePageIndex = UINT64_MAX;
+    blockIndex = UINT64_MAX;
+    position = 0;
+    uint64_t dataOffset = getDataOffset(header);
+    uint8_t indexHeader[HAT_INDEX_HEADER_SIZE];
+    seekIndex = SeekIndexHeader();
+    if (source->readAt(dataOffset + trackInfo.seekMarker, indexHeader, sizeof(indexHeader))) {
+        unpackSeekIndexHeader(indexHeader, seekIndex);
+    }
+    if (seekIndex.sync != HAT_INDEX_SYNC || seekIndex.pageEntries == 0 ||
+        seekIndex.blockCount != (getFrameCount() + header.blockFrames - 1) / header.blockFrames ||
+        seekIndex.pageCount != (seekIndex.blockCount + seekIndex.pageEntries - 1) / seekIndex.pageEntries) {
+        std::cerr << "\033[31m Seek index is missing or does not match the track length." << std::endl << "\033[39m";
+        return false;
+    }
+
+    std::vector<uint8_t> packedIndex(static_cast<size_t>(seekIndex.pageCount) * sizeof(uint64_t));
+    if (!source->readAt(dataOffset + trackInfo.seekMarker + HAT_INDEX_HEADER_SIZE, packedIndex.data(), packedIndex.size())) {
+        std::cerr << "\033[31m Seek index is truncated." << std::endl << "\033[39m";
+        return false;
+    }
+    coarseIndex.resize(seekIndex.pageCount);
+    unpackOffsets(packedIndex.data(), coarseIndex.size(), coarseIndex.data());
+
+    attachments.clear();
+    attachmentsLoaded = false;
+    indexLoaded = true;
+    return true;
+}
+
+bool HATDecoder::selectTrack(uint32_t track) {
+    trackIndex = track;
+    return open();
 }
 
-void HATDecoder::readHATHeader(std::ifstream& inputFile, HATHeader& header) {
-    char version[4];
-    inputFile.read(version, 4);
-    header.version = std::string(version, 4);
+bool HATDecoder::readHeader() {
+    // The fixed header is one small read, which keeps probing many files cheap
+    uint8_t headerData[HAT_HEADER_SIZE];
+    if (!source->readAt(0, headerData, sizeof(headerData))) {
+        std::cerr << "\033[31m File too small to contain a valid header." << std::endl << "\033[39m";
+        return false;
+    }
+    if (!unpackHATHeader(headerData, header, trackInfo)) {
+        return false;
+    }
 
-    inputFile.read(reinterpret_cast<char*>(&header.channels), sizeof(header.channels));
-    inputFile.read(reinterpret_cast<char*>(header.spatialData), sizeof(header.spatialData));
-    inputFile.read(reinterpret_cast<char*>(&header.compressionRatio), sizeof(header.compressionRatio));
-    inputFile.read(reinterpret_cast<char*>(&header.compressionMethod), sizeof(header.compressionMethod));
-    inputFile.read(reinterpret_cast<char*>(&header.tracks), sizeof(header.tracks));
-    inputFile.read(reinterpret_cast<char*>(&header.sampleRate), sizeof(header.sampleRate));
-    inputFile.read(reinterpret_cast<char*>(&header.bitRate), sizeof(header.bitRate));
-    inputFile.read(reinterpret_cast<char*>(&header.length), sizeof(header.length));
-    inputFile.read(reinterpret_cast<char*>(&header.datalength), sizeof(header.datalength));
+    // Checked before allocating, so a bad size cannot make us allocate more than the file holds
+    if (header.metadataSize > source->size() - HAT_HEADER_SIZE) {
+        std::cerr << "\033[31m Metadata chunk is truncated." << std::endl << "\033[39m";
+        return false;
+    }
+    std::vector<uint8_t> metadata(header.metadataSize);
+    if (!source->readAt(HAT_HEADER_SIZE, metadata.data(), metadata.size())) {
+        std::cerr << "\033[31m Metadata chunk is truncated." << std::endl << "\033[39m";
+        return false;
+    }
+    if (!unpackMetadata(metadata.data(), metadata.size(), trackInfo.metadata)) {
+        return false;
+    }
+    if (header.channels == 0 || header.blockFrames == 0) {
+        std::cerr << "\033[31m Invalid header! The file has no channels or no block size." << std::endl << "\033[39m";
+        return false;
+    }
+    return true;
 }
 
-void HATDecoder::readTrackInfo(std::ifstream& inputFile, TrackInfo& trackInfo) {
-    char artist[256];
-    inputFile.read(artist, sizeof(artist));
-    trackInfo.artist = std::string(artist);
+bool HATDecoder::openTrack(const uint8_t* directoryHeader) {
+    uint64_t dataOffset = getDataOffset(header);
+    uint64_t size = getTrackDirectorySize(directoryHeader);
+    std::vector<uint8_t> directory(size <= source->size() ? static_cast<size_t>(size) : 0);
+    std::vector<TrackDirectoryEntry> tracks;
+    if (directory.empty() || !source->readAt(dataOffset, directory.data(), directory.size()) ||
+        !unpackTrackDirectory(directory.data(), directory.size(), tracks)) {
+        std::cerr << "\033[31m Track directory is missing or damaged." << std::endl << "\033[39m";
+        return false;
+    }
 
-    char description[256];
-    inputFile.read(description, sizeof(description));
-    trackInfo.description = std::string(description);
+    trackCount = static_cast<uint32_t>(tracks.size());
+    if (trackIndex >= trackCount) {
+        std::cerr << "\033[31m Track " << trackIndex << " does not exist; the file has " << trackCount << " tracks." << std::endl << "\033[39m";
+        return false;
+    }
+    const TrackDirectoryEntry& track = tracks[trackIndex];
+    if (track.offset > source->size() - dataOffset || track.size > source->size() - dataOffset - track.offset) {
+        std::cerr << "\033[31m Track " << trackIndex << " is truncated." << std::endl << "\033[39m";
+        return false;
+    }
 
-    char trackName[256];
-    inputFile.read(trackName, sizeof(trackName));
-    trackInfo.trackName = std::string(trackName);
+    // From here on the track is read as if it were a file of its own
+    trackSource.reset(new HATRangeSource(*fileSource, dataOffset + track.offset, track.size));
+    source = trackSource.get();
+    return readHeader();
+}
 
-    inputFile.read(reinterpret_cast<char*>(&trackInfo.trackNumber), sizeof(trackInfo.trackNumber));
-    inputFile.read(reinterpret_cast<char*>(&trackInfo.seekMarker), sizeof(trackInfo.seekMarker));
+bool HATDecoder::setMix(const std::vector<uint32_t>& tracks, const std::vector<float>& gains) {
+    mixTracks.clear();
+    mixGains.clear();
+    mixPosition = 0;
+    mixFrameCount = 0;
+    if (tracks.empty() || tracks.size() != gains.size()) {
+        std::cerr << "\033[31m A mix needs one gain for each of its tracks." << std::endl << "\033[39m";
+        return false;
+    }
+    if (!indexLoaded && !open()) {
+        return false;
+    }
+
+    // Every track gets its own decoder, and so its own seek index and block,
+    // but they all read from the same source
+    std::vector<std::unique_ptr<HATDecoder>> decoders;
+    uint64_t frameCount = 0;
+    for (uint32_t track : tracks) {
+        std::unique_ptr<HATDecoder> decoder(new HATDecoder(*fileSource));
+        if (!decoder->selectTrack(track)) {
+            return false;
+        }
+        if (!decoders.empty() && (decoder->getChannels() != decoders[0]->getChannels() || decoder->getSampleRate() != decoders[0]->getSampleRate())) {
+            std::cerr << "\033[31m Track " << track << " does not have the channel count and sample rate of the other mixed tracks." << std::endl << "\033[39m";
+            return false;
+        }
+        frameCount = std::max(frameCount, decoder->getFrameCount());
+        decoders.push_back(std::move(decoder));
+    }
+
+    size_t blockSamples = static_cast<size_t>(decoders[0]->header.blockFrames) * decoders[0]->getChannels();
+    mixBlock.resize(blockSamples);
+    mixAccumulator.resize(blockSamples);
+    mixTracks = std::move(decoders);
+    mixGains = gains;
+    mixFrameCount = frameCount;
+    return true;
 }
 
-std::vector<int16_t> HATDecoder::decompressData(const std::vector<uint8_t>& compressedData, size_t dataSize) {
-    // Remove checksum before decompression
-    std::vector<uint8_t> dataWithoutChecksum(compressedData.begin(), compressedData.end() - 2);
+bool HATDecoder::setMixGain(size_t index, float gain) {
+    if (index >= mixGains.size()) {
+        std::cerr << "\033[31m The mix has no track " << index << "." << std::endl << "\033[39m";
+        return false;
+    }
+    mixGains[index] = gain;
+    return true;
+}
 
-    std::vector<uint8_t> stageData = dataWithoutChecksum;
-    for (int stage = 0; stage < 3; ++stage) { // Apply 3 stages of decompression
-        stageData = decompressStage(stageData);
+bool HATDecoder::seekMix(uint64_t frame) {
+    if (mixTracks.empty()) {
+        std::cerr << "\033[31m No mix has been set up." << std::endl << "\033[39m";
+        return false;
+    }
+    if (frame > mixFrameCount) {
+        std::cerr << "\033[31m Seek position " << frame << " is past the end of the mix (" << mixFrameCount << " frames)." << std::endl << "\033[39m";
+        return false;
     }
+    // The tracks catch up in readMix(), so muted ones are never touched
+    mixPosition = frame;
+    return true;
+}
 
-    std::vector<int16_t> decompressedData;
-    decompressedData.reserve(dataSize);
-    size_t i = 0;
+size_t HATDecoder::readMix(int16_t* dst, size_t frames) {
+    if (mixTracks.empty()) {
+        return 0;
+    }
 
-    while (i < stageData.size()) {
-        uint8_t runLength = stageData[i];
-        int16_t value = static_cast<int16_t>(stageData[i + 1]) | (static_cast<int16_t>(stageData[i + 2]) << 8);
+    size_t channels = mixTracks[0]->getChannels();
+    size_t blockFrames = mixBlock.size() / channels;
+    size_t framesRead = 0;
+    while (framesRead < frames && mixPosition < mixFrameCount) {
+        size_t count = static_cast<size_t>(std::min<uint64_t>(std::min(frames - framesRead, blockFrames), mixFrameCount - mixPosition));
+        std::fill(mixAccumulator.begin(), mixAccumulator.begin() + count * channels, 0.0f);
 
-        for (size_t j = 0; j < runLength; ++j) {
-            decompressedData.push_back(value);
+        for (size_t i = 0; i < mixTracks.size(); ++i) {
+            HATDecoder& track = *mixTracks[i];
+            if (mixGains[i] == 0.0f || mixPosition >= track.getFrameCount()) {
+                continue;
+            }
+            // A track that was muted or seeked away from has to catch up first
+            if (track.getPosition() != mixPosition && !track.seek(mixPosition)) {
+                continue;
+            }
+            size_t trackFrames = track.read(mixBlock.data(), count);
+            mixAccumulate(mixAccumulator.data(), mixBlock.data(), trackFrames * channels, mixGains[i]);
         }
 
-        i += 3;
+        mixStore(dst + framesRead * channels, mixAccumulator.data(), count * channels);
+        framesRead += count;
+        mixPosition += count;
     }
+    return framesRead;
+}
 
-    if (decompressedData.size() != dataSize) {
-        std::cerr << "\033[31m Decompression failed! Size mismatch. Expected: " << dataSize << ", Got: " << decompressedData.size() << std::endl << "\033[39m";
-        return {};
+const std::vector<AttachmentInfo>& HATDecoder::getAttachments() {
+    if (!attachmentsLoaded) {
+        loadAttachments();
     }
+    return attachments;
+}
 
-    return decompressedData;
+bool HATDecoder::readAttachment(uint32_t id, std::vector<uint8_t>& data) {
+    const std::vector<AttachmentInfo>& list = getAttachments();
+    for (const AttachmentInfo& attachment : list) {
+        if (attachment.id != id) {
+            continue;
+        }
+
+        uint64_t offset = getDataOffset(header) + attachment.offset;
+        bool fits = attachment.size <= source->size();
+        data.resize(fits ? static_cast<size_t>(attachment.size) : 0);
+        if (!fits || !source->readAt(offset, data.data(), data.size())) {
+            std::cerr << "\033[31m Attachment " << id << " is truncated." << std::endl << "\033[39m";
+            data.clear();
+            return false;
+        }
+        if (calculateCRC32(data.data(), data.size()) != attachment.crc) {
+            std::cerr << "\033[31m Checksum mismatch in attachment " << id << "! Data may be corrupted." << std::endl << "\033[39m";
+            data.clear();
+            return false;
+        }
+        return true;
+    }
+
+    std::cerr << "\033[31m No attachment with id " << id << "." << std::endl << "\033[39m";
+    data.clear();
+    return false;
 }
 
-std::vector<uint8_t> HATDecoder::decompressStage(const std::vector<uint8_t>& data) {
-    std::vector<uint8_t> decompressedData;
-    size_t i = 0;
+bool HATDecoder::loadAttachments() {
+    if (attachmentsLoaded) {
+        return true;
+    }
+    if (!indexLoaded && !open()) {
+        return false;
+    }
+    attachmentsLoaded = true;
+    if (header.attachmentDirectory == 0) {
+        return true;
+    }
+
+    uint64_t offset = getDataOffset(header) + header.attachmentDirectory;
+    uint8_t directoryHeader[HAT_ATTACHMENT_HEADER_SIZE];
+    if (source->readAt(offset, directoryHeader, sizeof(directoryHeader))) {
+        uint64_t size = getAttachmentDirectorySize(directoryHeader);
+        if (size > 0 && size <= source->size()) {
+            std::vector<uint8_t> directory(static_cast<size_t>(size));
+            if (source->readAt(offset, directory.data(), directory.size()) &&
+                unpackAttachmentDirectory(directory.data(), directory.size(), attachments)) {
+                attachmentDirectoryEnd = offset + size;
+                return true;
+            }
+        }
+    }
+
+    std::cerr << "\033[31m Attachment directory is missing or damaged." << std::endl << "\033[39m";
+    return false;
+}
+
+bool HATDecoder::findBlock(uint64_t index, uint64_t& offset) {
+    uint64_t page = index / seekIndex.pageEntries;
+    if (page != finePageIndex) {
+        uint64_t first = page * seekIndex.pageEntries;
+        finePage.resize(std::min<uint64_t>(seekIndex.blockCount - first, seekIndex.pageEntries));
+
+        uint64_t pageOffset = getDataOffset(header) + coarseIndex[page];
+        std::vector<uint8_t> packedPage(HAT_PAGE_HEADER_SIZE + finePage.size() * sizeof(uint64_t));
+        SeekPageHeader pageHeader = SeekPageHeader();
+        if (source->readAt(pageOffset, packedPage.data(), packedPage.size())) {
+            unpackSeekPageHeader(packedPage.data(), pageHeader);
+            unpackOffsets(packedPage.data() + HAT_PAGE_HEADER_SIZE, finePage.size(), finePage.data());
+        }
+        if (pageHeader.sync != HAT_PAGE_SYNC || pageHeader.entries != finePage.size()) {
+            std::cerr << "\033[31m Seek index page " << page << " is damaged." << std::endl << "\033[39m";
+            finePage.clear();
+            finePageIndex = UINT64_MAX;
+            return false;
+        }
+        finePageIndex = page;
+    }
+
+    offset = getDataOffset(header) + finePage[index % seekIndex.pageEntries];
+    return true;
+}
+
+bool HATDecoder::loadBlock(uint64_t index, bool randomAccess) {
+    uint64_t offset = 0;
+    if (!findBlock(index, offset)) {
+        return false;
+    }
+
+    // Only the last block may be short; any other frame count would leave read()
+    // indexing past the samples the block actually holds
+    uint64_t frames = std::min<uint64_t>(header.blockFrames, getFrameCount() - index * header.blockFrames);
+    if (!readBlock(offset, frames, randomAccess, blockData)) {
+        blockIndex = UINT64_MAX;
+        return false;
+    }
+    blockIndex = index;
+    return true;
+}
+
+bool HATDecoder::readBlock(uint64_t offset, uint64_t frames, bool randomAccess, std::vector<int16_t>& blockSamples) {
+    uint8_t packedHeader[HAT_BLOCK_HEADER_SIZE];
+    BlockHeader blockHeader = BlockHeader();
+    if (source->readAt(offset, packedHeader, sizeof(packedHeader))) {
+        unpackBlockHeader(packedHeader, blockHeader);
+    }
+    if (blockHeader.sync != HAT_BLOCK_SYNC || blockHeader.frames != frames || blockHeader.size < 2) {
+        std::cerr << "\033[31m Invalid block header! Data may be corrupted." << std::endl << "\033[39m";
+        return false;
+    }
+
+    uint64_t payloadOffset = offset + HAT_BLOCK_HEADER_SIZE;
+    if (payloadOffset + blockHeader.size > source->size()) {
+        std::cerr << "\033[31m Block is truncated! Data may be corrupted." << std::endl << "\033[39m";
+        return false;
+    }
+
+    // When the source holds the file in memory the payload is decompressed in place
+    const uint8_t* payload = source->data();
+    if (payload) {
+        payload += payloadOffset;
+        if (randomAccess) {
+            // A seek lands away from the sequential read-ahead; fault the whole block in at once
+            source->willNeed(offset, HAT_BLOCK_HEADER_SIZE + blockHeader.size);
+        }
+    } else {
+        compressedBlock.resize(blockHeader.size);
+        if (!source->readAt(payloadOffset, compressedBlock.data(), compressedBlock.size())) {
+            std::cerr << "\033[31m Block is truncated! Data may be corrupted." << std::endl << "\033[39m";
+            return false;
+        }
+        payload = compressedBlock.data();
+    }
+
+    // Verify checksum before decompression
+    if (calculateCRC32(payload, blockHeader.size) != blockHeader.crc || !verifyChecksum(payload, blockHeader.size)) {
+        std::cerr << "\033[31m Checksum mismatch! Data may be corrupted." << std::endl << "\033[39m";
+        return false;
+    }
+
+    blockSamples = ::decompressData(payload, blockHeader.size, static_cast<size_t>(blockHeader.frames) * header.channels);
+
+    // The block now lives in blockSamples; a mapped source can drop its pages so
+    // streaming a long file does not leave all of it resident
+    source->release(offset, HAT_BLOCK_HEADER_SIZE + blockHeader.size);
+    return !blockSamples.empty();
+}
+
+bool verifyChecksum(const std::vector<uint8_t>& compressedData) {
+    return verifyChecksum(compressedData.data(), compressedData.size());
+}
+
+bool verifyChecksum(const uint8_t* compressedData, size_t size) {
+    if (size < 2) {
+        return false;
+    }
+    uint16_t storedChecksum = static_cast<uint16_t>(compressedData[size - 2]) |
+                              (static_cast<uint16_t>(compressedData[size - 1]) << 8);
+    uint16_t calculatedChecksum = std::accumulate(compressedData, compressedData + size - 2, 0u);
+    return storedChecksum == calculatedChecksum;
+}
+
+static std::vector<uint8_t> decompressStage(const uint8_t* data, size_t size) {
+    size_t decompressedSize = 0;
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        decompressedSize += data[i];
+    }
 
-    while (i < data.size()) {
+    std::vector<uint8_t> decompressedData(decompressedSize);
+    uint8_t* out = decompressedData.data();
+    for (size_t i = 0; i + 1 < size; i += 2) {
         uint8_t runLength = data[i];
         uint8_t value = data[i + 1];
 
-        for (size_t j = 0; j < runLength; ++j) {
-            decompressedData.push_back(value);
-        }
+        std::memset(out, value, runLength);
+        out += runLength;
+    }
+
+    return decompressedData;
+}
+
+static std::vector<uint8_t> decompressStage(const std::vector<uint8_t>& data) {
+    return decompressStage(data.data(), data.size());
+}
 
-        i += 2;
+std::vector<int16_t> decompressData(const std::vector<uint8_t>& compressedData, size_t dataSize) {
+    if (compressedData.size() < 2) {
+        return {};
+    }
+    return decompressData(compressedData.data(), compressedData.size(), dataSize);
+}
+
+std::vector<int16_t> decompressData(const uint8_t* compressedData, size_t size, size_t dataSize) {
+    // The first stage reads the compressed bytes where they are, minus the checksum
+    std::vector<uint8_t> stageData = decompressStage(compressedData, size - 2);
+    for (int stage = 1; stage < 3; ++stage) { // Apply 3 stages of decompression
+        stageData = decompressStage(stageData);
+    }
+
+    // Size the output up front so a block decodes without reallocating
+    size_t decodedSize = 0;
+    for (size_t i = 0; i + 2 < stageData.size(); i += 3) {
+        decodedSize += stageData[i];
+    }
+    if (decodedSize != dataSize) {
+        std::cerr << "\033[31m Decompression failed! Size mismatch. Expected: " << dataSize << ", Got: " << decodedSize << std::endl << "\033[39m";
+        return {};
+    }
+
+    std::vector<int16_t> decompressedData(dataSize);
+    int16_t* out = decompressedData.data();
+    for (size_t i = 0; i + 2 < stageData.size(); i += 3) {
+        uint8_t runLength = stageData[i];
+        int16_t value = static_cast<int16_t>(stageData[i + 1]) | (static_cast<int16_t>(stageData[i + 2]) << 8);
+
+        std::fill(out, out + runLength, value);
+        out += runLength;
     }
 
     return decompressedData;
-}
\ No newline at end of file
+}
+
+std::vector<int16_t> HATDecoder::decompressData(const std::vector<uint8_t>& compressedData, size_t dataSize) {
+    return ::decompressData(compressedData, dataSize);
+}
+
+std::vector<uint8_t> HATDecoder::decompressStage(const std::vector<uint8_t>& data) {
+    return ::decompressStage(data);
+}
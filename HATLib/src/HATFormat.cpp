@@ -1,5 +1,7 @@
 #include "HATFormat.h"
 #include <iostream>
+#include <cstring>
+#include <algorithm>
 
 void printHATHeader(const HATHeader& header) {
     std::cout << "HAT Version: " << header.version << std::endl;
@@ -13,3 +15,507 @@ void printHATHeader(const HATHeader& header) {
     std::cout << "Bit Rate: " << header.bitRate << std::endl;
     std::cout << "Length: " << header.length << std::endl;
 }
+
+uint16_t calculateChecksum(const std::vector<uint8_t>& data) {
+    uint16_t checksum = 0;
+    for (auto byte : data) {
+        checksum += byte;
+    }
+    return checksum;
+}
+
+
+
+std::vector<uint8_t> compressData(const std::vector<int16_t>& data, float& compressionRatio) {
+    std::vector<uint8_t> compressedData;
+    size_t dataSize = data.size();
+    size_t i = 0;
+
+    while (i < dataSize) {
+        int16_t value = data[i];
+        size_t runLength = 1;
+        
+        while (i + runLength < dataSize && data[i + runLength] == value && runLength < 255) {
+            runLength++;
+        }
+        
+        compressedData.push_back(static_cast<uint8_t>(runLength));
+        compressedData.push_back(static_cast<uint8_t>(value & 0xFF));
+        compressedData.push_back(static_cast<uint8_t>((value >> 8) & 0xFF));
+
+        i += runLength;
+    }
+
+    // Multi-stage compression
+    std::vector<uint8_t> tempData = compressedData;
+    for (int stage = 0; stage < 3; ++stage) { // Apply 3 stages of compression
+        std::vector<uint8_t> stageCompressedData;
+        size_t tempSize = tempData.size();
+        size_t j = 0;
+
+        while (j < tempSize) {
+            uint8_t value = tempData[j];
+            size_t runLength = 1;
+            
+            while (j + runLength < tempSize && tempData[j + runLength] == value && runLength < 255) {
+                runLength++;
+            }
+            
+            stageCompressedData.push_back(static_cast<uint8_t>(runLength));
+            stageCompressedData.push_back(value);
+
+            j += runLength;
+        }
+
+        tempData = stageCompressedData;
+    }
+
+    compressedData = tempData;
+
+   
+    uint16_t checksum = calculateChecksum(compressedData);
+    compressedData.push_back(static_cast<uint8_t>(checksum & 0xFF));
+    compressedData.push_back(static_cast<uint8_t>((checksum >> 8) & 0xFF));
+
+    compressionRatio = static_cast<float>(dataSize * sizeof(int16_t)) / static_cast<float>(compressedData.size());
+    return compressedData;
+}
+
+uint64_t getMaxCompressedSize(size_t samples) {
+    // Every sample can be a run of its own (3 bytes), every byte stage can
+    // double its input, and the checksum takes 2 bytes
+    return static_cast<uint64_t>(samples) * 3 * 8 + 2;
+}
+
+uint32_t calculateCRC32(const uint8_t* data, size_t size, uint32_t crc) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> entries(256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            }
+            entries[i] = value;
+        }
+        return entries;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void putU32(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+    out[2] = static_cast<uint8_t>(value >> 16);
+    out[3] = static_cast<uint8_t>(value >> 24);
+}
+
+static uint32_t getU32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+static void putU64(uint8_t* out, uint64_t value) {
+    putU32(out, static_cast<uint32_t>(value));
+    putU32(out + 4, static_cast<uint32_t>(value >> 32));
+}
+
+static uint64_t getU64(const uint8_t* data) {
+    return static_cast<uint64_t>(getU32(data)) | (static_cast<uint64_t>(getU32(data + 4)) << 32);
+}
+
+static void putString16(std::vector<uint8_t>& out, const std::string& value) {
+    size_t length = std::min<size_t>(value.size(), UINT16_MAX);
+    out.push_back(static_cast<uint8_t>(length));
+    out.push_back(static_cast<uint8_t>(length >> 8));
+    out.insert(out.end(), value.begin(), value.begin() + length);
+}
+
+// Reads a string with a 2 byte length, advancing `data`. Fails if it runs past `end`.
+static bool getString16(const uint8_t*& data, const uint8_t* end, std::string& value) {
+    if (end - data < 2) {
+        return false;
+    }
+    size_t length = static_cast<size_t>(data[0]) | (static_cast<size_t>(data[1]) << 8);
+    data += sizeof(uint16_t);
+    if (static_cast<size_t>(end - data) < length) {
+        return false;
+    }
+    value.assign(reinterpret_cast<const char*>(data), length);
+    data += length;
+    return true;
+}
+
+static void putFloat(uint8_t* out, float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    putU32(out, bits);
+}
+
+static float getFloat(const uint8_t* data) {
+    uint32_t bits = getU32(data);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void packHATHeader(const HATHeader& header, const TrackInfo& trackInfo, uint8_t* out) {
+    std::memset(out, 0, HAT_HEADER_SIZE);
+    header.version.copy(reinterpret_cast<char*>(out), 4);
+    out[4] = header.channels;
+    out[5] = header.tracks;
+    // Bytes 6 and 7 are reserved
+    putFloat(out + 8, header.spatialData[0]);
+    putFloat(out + 12, header.spatialData[1]);
+    putFloat(out + 16, header.spatialData[2]);
+    putFloat(out + 20, header.compressionRatio);
+    putU32(out + 24, static_cast<uint32_t>(header.compressionMethod));
+    putU32(out + 28, header.sampleRate);
+    putU32(out + 32, header.bitRate);
+    putU32(out + 36, header.blockFrames);
+    putU64(out + 40, header.length);
+    putU64(out + 48, header.datalength);
+    putU64(out + 56, trackInfo.seekMarker);
+    putU64(out + 64, header.attachmentDirectory);
+    putU32(out + 72, static_cast<uint32_t>(trackInfo.trackNumber));
+    putU32(out + 76, header.metadataSize);
+    putU32(out + 80, calculateCRC32(out, HAT_HEADER_SIZE - sizeof(uint32_t)));
+}
+
+bool unpackHATHeader(const uint8_t* data, HATHeader& header, TrackInfo& trackInfo) {
+    header.version = std::string(reinterpret_cast<const char*>(data), strnlen(reinterpret_cast<const char*>(data), 4));
+    if (header.version == "1.0") {
+        std::cerr << "\033[31m This is a HAT 1.0 file. Convert it with upgradeHATFile() or HATEncoder --upgrade." << std::endl << "\033[39m";
+        return false;
+    }
+    if (header.version != HAT_VERSION) {
+        std::cerr << "\033[31m Unsupported HAT version: " << header.version << std::endl << "\033[39m";
+        return false;
+    }
+    if (calculateCRC32(data, HAT_HEADER_SIZE - sizeof(uint32_t)) != getU32(data + 80)) {
+        std::cerr << "\033[31m Header checksum mismatch! The header is damaged." << std::endl << "\033[39m";
+        return false;
+    }
+
+    header.channels = data[4];
+    header.tracks = data[5];
+    header.spatialData[0] = getFloat(data + 8);
+    header.spatialData[1] = getFloat(data + 12);
+    header.spatialData[2] = getFloat(data + 16);
+    header.compressionRatio = getFloat(data + 20);
+    header.compressionMethod = static_cast<CompressionMethod>(getU32(data + 24));
+    header.sampleRate = getU32(data + 28);
+    header.bitRate = getU32(data + 32);
+    header.blockFrames = getU32(data + 36);
+    header.length = getU64(data + 40);
+    header.datalength = getU64(data + 48);
+    trackInfo.seekMarker = getU64(data + 56);
+    header.attachmentDirectory = getU64(data + 64);
+    trackInfo.trackNumber = static_cast<int32_t>(getU32(data + 72));
+    header.metadataSize = getU32(data + 76);
+    if (header.metadataSize > HAT_MAX_METADATA_SIZE) {
+        std::cerr << "\033[31m Metadata chunk of " << header.metadataSize << " bytes is too large." << std::endl << "\033[39m";
+        return false;
+    }
+    return true;
+}
+
+const std::string& getMetadataValue(const TrackInfo& trackInfo, const std::string& key) {
+    static const std::string empty;
+    std::map<std::string, std::string>::const_iterator it = trackInfo.metadata.find(key);
+    return it != trackInfo.metadata.end() ? it->second : empty;
+}
+
+uint32_t getMetadataChunkSize(const std::map<std::string, std::string>& metadata) {
+    size_t size = HAT_METADATA_HEADER_SIZE;
+    for (const auto& entry : metadata) {
+        size += sizeof(uint16_t) + entry.first.size() + sizeof(uint32_t) + entry.second.size();
+    }
+    return static_cast<uint32_t>(std::min<size_t>(size, UINT32_MAX));
+}
+
+bool packMetadata(const std::map<std::string, std::string>& metadata, uint8_t* out, size_t size) {
+    if (size == 0 && metadata.empty()) {
+        return true;
+    }
+    if (getMetadataChunkSize(metadata) > size) {
+        return false;
+    }
+
+    std::memset(out, 0, size);
+    uint8_t* entry = out + HAT_METADATA_HEADER_SIZE;
+    for (const auto& item : metadata) {
+        if (item.first.size() > UINT16_MAX) {
+            return false;
+        }
+        entry[0] = static_cast<uint8_t>(item.first.size());
+        entry[1] = static_cast<uint8_t>(item.first.size() >> 8);
+        entry = std::copy(item.first.begin(), item.first.end(), entry + sizeof(uint16_t));
+        putU32(entry, static_cast<uint32_t>(item.second.size()));
+        entry = std::copy(item.second.begin(), item.second.end(), entry + sizeof(uint32_t));
+    }
+
+    uint32_t used = static_cast<uint32_t>(entry - out - HAT_METADATA_HEADER_SIZE);
+    putU32(out, HAT_METADATA_SYNC);
+    putU32(out + 4, used);
+    putU32(out + 8, calculateCRC32(out + HAT_METADATA_HEADER_SIZE, used));
+    return true;
+}
+
+bool unpackMetadata(const uint8_t* data, size_t size, std::map<std::string, std::string>& metadata) {
+    metadata.clear();
+    if (size == 0) {
+        return true;
+    }
+
+    uint32_t used = size >= HAT_METADATA_HEADER_SIZE ? getU32(data + 4) : 0;
+    if (size < HAT_METADATA_HEADER_SIZE || getU32(data) != HAT_METADATA_SYNC || used > size - HAT_METADATA_HEADER_SIZE ||
+        calculateCRC32(data + HAT_METADATA_HEADER_SIZE, used) != getU32(data + 8)) {
+        std::cerr << "\033[31m Metadata chunk is damaged." << std::endl << "\033[39m";
+        return false;
+    }
+
+    const uint8_t* entry = data + HAT_METADATA_HEADER_SIZE;
+    const uint8_t* end = entry + used;
+    while (entry < end) {
+        if (end - entry < 2) {
+            break;
+        }
+        size_t keyLength = static_cast<size_t>(entry[0]) | (static_cast<size_t>(entry[1]) << 8);
+        entry += sizeof(uint16_t);
+        if (static_cast<size_t>(end - entry) < keyLength + sizeof(uint32_t)) {
+            break;
+        }
+        std::string key(reinterpret_cast<const char*>(entry), keyLength);
+        entry += keyLength;
+        size_t valueLength = getU32(entry);
+        entry += sizeof(uint32_t);
+        if (static_cast<size_t>(end - entry) < valueLength) {
+            break;
+        }
+        metadata[key] = std::string(reinterpret_cast<const char*>(entry), valueLength);
+        entry += valueLength;
+    }
+
+    if (entry != end) {
+        std::cerr << "\033[31m Metadata chunk is damaged." << std::endl << "\033[39m";
+        metadata.clear();
+        return false;
+    }
+    return true;
+}
+
+std::vector<uint8_t> packAttachmentDirectory(const std::vector<AttachmentInfo>& attachments) {
+    std::vector<uint8_t> directory(HAT_ATTACHMENT_HEADER_SIZE);
+    uint8_t field[8];
+    for (const AttachmentInfo& attachment : attachments) {
+        putU32(field, attachment.id);
+        directory.insert(directory.end(), field, field + 4);
+        putU64(field, attachment.offset);
+        directory.insert(directory.end(), field, field + 8);
+        putU64(field, attachment.size);
+        directory.insert(directory.end(), field, field + 8);
+        putU32(field, attachment.crc);
+        directory.insert(directory.end(), field, field + 4);
+        putString16(directory, attachment.name);
+        putString16(directory, attachment.mimeType);
+    }
+
+    size_t used = directory.size() - HAT_ATTACHMENT_HEADER_SIZE;
+    putU32(directory.data(), HAT_ATTACHMENT_SYNC);
+    putU32(directory.data() + 4, static_cast<uint32_t>(used));
+    putU32(directory.data() + 8, calculateCRC32(directory.data() + HAT_ATTACHMENT_HEADER_SIZE, used));
+    return directory;
+}
+
+uint64_t getAttachmentDirectorySize(const uint8_t* data) {
+    if (getU32(data) != HAT_ATTACHMENT_SYNC) {
+        return 0;
+    }
+    return HAT_ATTACHMENT_HEADER_SIZE + static_cast<uint64_t>(getU32(data + 4));
+}
+
+bool unpackAttachmentDirectory(const uint8_t* data, size_t size, std::vector<AttachmentInfo>& attachments) {
+    attachments.clear();
+    bool valid = size >= HAT_ATTACHMENT_HEADER_SIZE && getAttachmentDirectorySize(data) == size &&
+                 calculateCRC32(data + HAT_ATTACHMENT_HEADER_SIZE, size - HAT_ATTACHMENT_HEADER_SIZE) == getU32(data + 8);
+
+    const uint8_t* entry = data + HAT_ATTACHMENT_HEADER_SIZE;
+    const uint8_t* end = data + size;
+    while (valid && entry < end) {
+        AttachmentInfo attachment;
+        if (end - entry < 24) {
+            valid = false;
+            break;
+        }
+        attachment.id = getU32(entry);
+        attachment.offset = getU64(entry + 4);
+        attachment.size = getU64(entry + 12);
+        attachment.crc = getU32(entry + 20);
+        entry += 24;
+        valid = getString16(entry, end, attachment.name) && getString16(entry, end, attachment.mimeType);
+        attachments.push_back(attachment);
+    }
+
+    if (!valid) {
+        std::cerr << "\033[31m Attachment directory is damaged." << std::endl << "\033[39m";
+        attachments.clear();
+    }
+    return valid;
+}
+
+uint32_t unpackU32(const uint8_t* data) {
+    return getU32(data);
+}
+
+void packBlockHeader(const BlockHeader& blockHeader, uint8_t* out) {
+    putU32(out, blockHeader.sync);
+    putU32(out + 4, blockHeader.frames);
+    putU32(out + 8, blockHeader.size);
+    putU32(out + 12, blockHeader.crc);
+}
+
+void unpackBlockHeader(const uint8_t* data, BlockHeader& blockHeader) {
+    blockHeader.sync = getU32(data);
+    blockHeader.frames = getU32(data + 4);
+    blockHeader.size = getU32(data + 8);
+    blockHeader.crc = getU32(data + 12);
+}
+
+void unpackSeekPageHeader(const uint8_t* data, SeekPageHeader& pageHeader) {
+    pageHeader.sync = getU32(data);
+    pageHeader.entries = getU32(data + 4);
+}
+
+void unpackSeekIndexHeader(const uint8_t* data, SeekIndexHeader& seekIndex) {
+    seekIndex.sync = getU32(data);
+    seekIndex.blockCount = getU32(data + 4);
+    seekIndex.pageEntries = getU32(data + 8);
+    seekIndex.pageCount = getU32(data + 12);
+}
+
+void unpackCheckpointHeader(const uint8_t* data, CheckpointHeader& checkpoint) {
+    checkpoint.sync = getU32(data);
+    checkpoint.blockCount = getU32(data + 4);
+    checkpoint.pageEntries = getU32(data + 8);
+    checkpoint.pageCount = getU32(data + 12);
+    checkpoint.partialCount = getU32(data + 16);
+}
+
+void unpackOffsets(const uint8_t* data, size_t count, uint64_t* offsets) {
+    for (size_t i = 0; i < count; ++i) {
+        offsets[i] = getU64(data + i * sizeof(uint64_t));
+    }
+}
+
+static uint8_t* putOffsets(uint8_t* out, const std::vector<uint64_t>& offsets) {
+    for (uint64_t offset : offsets) {
+        putU64(out, offset);
+        out += sizeof(uint64_t);
+    }
+    return out;
+}
+
+std::vector<uint8_t> packSeekPage(const std::vector<uint64_t>& blockOffsets) {
+    std::vector<uint8_t> page(HAT_PAGE_HEADER_SIZE + blockOffsets.size() * sizeof(uint64_t));
+    putU32(page.data(), HAT_PAGE_SYNC);
+    putU32(page.data() + 4, static_cast<uint32_t>(blockOffsets.size()));
+    putOffsets(page.data() + HAT_PAGE_HEADER_SIZE, blockOffsets);
+    return page;
+}
+
+std::vector<uint8_t> packSeekIndex(uint32_t blockCount, const std::vector<uint64_t>& pageOffsets) {
+    std::vector<uint8_t> index(HAT_INDEX_HEADER_SIZE + pageOffsets.size() * sizeof(uint64_t));
+    putU32(index.data(), HAT_INDEX_SYNC);
+    putU32(index.data() + 4, blockCount);
+    putU32(index.data() + 8, HAT_SEEK_PAGE_ENTRIES);
+    putU32(index.data() + 12, static_cast<uint32_t>(pageOffsets.size()));
+    putOffsets(index.data() + HAT_INDEX_HEADER_SIZE, pageOffsets);
+    return index;
+}
+
+std::vector<uint8_t> packCheckpoint(uint32_t blockCount, const std::vector<uint64_t>& pageOffsets, const std::vector<uint64_t>& blockOffsets) {
+    size_t size = HAT_CHECKPOINT_HEADER_SIZE + (pageOffsets.size() + blockOffsets.size()) * sizeof(uint64_t);
+    std::vector<uint8_t> checkpoint(size + sizeof(uint32_t));
+    putU32(checkpoint.data(), HAT_CHECKPOINT_SYNC);
+    putU32(checkpoint.data() + 4, blockCount);
+    putU32(checkpoint.data() + 8, HAT_SEEK_PAGE_ENTRIES);
+    putU32(checkpoint.data() + 12, static_cast<uint32_t>(pageOffsets.size()));
+    putU32(checkpoint.data() + 16, static_cast<uint32_t>(blockOffsets.size()));
+    uint8_t* out = putOffsets(checkpoint.data() + HAT_CHECKPOINT_HEADER_SIZE, pageOffsets);
+    putOffsets(out, blockOffsets);
+    putU32(checkpoint.data() + size, calculateCRC32(checkpoint.data(), size));
+    return checkpoint;
+}
+
+std::vector<uint8_t> packTrackDirectory(const std::vector<TrackDirectoryEntry>& tracks) {
+    std::vector<uint8_t> directory(HAT_TRACK_HEADER_SIZE + tracks.size() * HAT_TRACK_ENTRY_SIZE);
+    uint8_t* entry = directory.data() + HAT_TRACK_HEADER_SIZE;
+    for (const TrackDirectoryEntry& track : tracks) {
+        putU64(entry, track.offset);
+        putU64(entry + 8, track.size);
+        entry += HAT_TRACK_ENTRY_SIZE;
+    }
+
+    size_t used = directory.size() - HAT_TRACK_HEADER_SIZE;
+    putU32(directory.data(), HAT_TRACK_SYNC);
+    putU32(directory.data() + 4, static_cast<uint32_t>(used));
+    putU32(directory.data() + 8, calculateCRC32(directory.data() + HAT_TRACK_HEADER_SIZE, used));
+    return directory;
+}
+
+uint64_t getTrackDirectorySize(const uint8_t* data) {
+    if (getU32(data) != HAT_TRACK_SYNC) {
+        return 0;
+    }
+    return HAT_TRACK_HEADER_SIZE + static_cast<uint64_t>(getU32(data + 4));
+}
+
+bool unpackTrackDirectory(const uint8_t* data, size_t size, std::vector<TrackDirectoryEntry>& tracks) {
+    tracks.clear();
+    if (size < HAT_TRACK_HEADER_SIZE || getTrackDirectorySize(data) != size || (size - HAT_TRACK_HEADER_SIZE) % HAT_TRACK_ENTRY_SIZE != 0 ||
+        calculateCRC32(data + HAT_TRACK_HEADER_SIZE, size - HAT_TRACK_HEADER_SIZE) != getU32(data + 8)) {
+        std::cerr << "\033[31m Track directory is damaged." << std::endl << "\033[39m";
+        return false;
+    }
+
+    for (const uint8_t* entry = data + HAT_TRACK_HEADER_SIZE; entry < data + size; entry += HAT_TRACK_ENTRY_SIZE) {
+        TrackDirectoryEntry track;
+        track.offset = getU64(entry);
+        track.size = getU64(entry + 8);
+        tracks.push_back(track);
+    }
+    return true;
+}
+
+bool readHATHeader(std::istream& inputFile, HATHeader& header, TrackInfo& trackInfo) {
+    uint8_t data[HAT_HEADER_SIZE];
+    if (!inputFile.read(reinterpret_cast<char*>(data), sizeof(data))) {
+        std::cerr << "\033[31m File too small to contain a valid header." << std::endl << "\033[39m";
+        return false;
+    }
+    if (!unpackHATHeader(data, header, trackInfo)) {
+        return false;
+    }
+
+    std::vector<uint8_t> metadata(header.metadataSize);
+    if (!inputFile.read(reinterpret_cast<char*>(metadata.data()), metadata.size())) {
+        std::cerr << "\033[31m Metadata chunk is truncated." << std::endl << "\033[39m";
+        return false;
+    }
+    return unpackMetadata(metadata.data(), metadata.size(), trackInfo.metadata);
+}
+
+bool writeHATHeader(std::ostream& outputFile, const HATHeader& header, const TrackInfo& trackInfo) {
+    std::vector<uint8_t> data(HAT_HEADER_SIZE + header.metadataSize);
+    packHATHeader(header, trackInfo, data.data());
+    if (!packMetadata(trackInfo.metadata, data.data() + HAT_HEADER_SIZE, header.metadataSize)) {
+        std::cerr << "\033[31m Metadata does not fit in its chunk." << std::endl << "\033[39m";
+        return false;
+    }
+    return static_cast<bool>(outputFile.write(reinterpret_cast<const char*>(data.data()), data.size()));
+}
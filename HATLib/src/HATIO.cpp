@@ -0,0 +1,257 @@
+#include "HATIO.h"
+#include <cstring>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static bool inRange(uint64_t offset, uint64_t count, uint64_t size) {
+    return offset <= size && count <= size - offset;
+}
+
+bool HATMemorySource::readAt(uint64_t offset, void* dst, size_t count) {
+    if (!inRange(offset, count, byteCount)) {
+        return false;
+    }
+    // An empty read may come with a null dst, e.g. an empty vector's data()
+    if (count > 0) {
+        std::memcpy(dst, bytes + offset, count);
+    }
+    return true;
+}
+
+bool HATRangeSource::readAt(uint64_t offset, void* dst, size_t count) {
+    if (!inRange(offset, count, byteCount)) {
+        return false;
+    }
+    return parent.readAt(start + offset, dst, count);
+}
+
+HATFileSource::HATFileSource() : start(0), byteCount(0) {}
+
+bool HATFileSource::open(const std::string& filePath, uint64_t offset, uint64_t size) {
+    stream.open(filePath, std::ios::binary | std::ios::ate);
+    if (!stream.is_open()) {
+        return false;
+    }
+
+    uint64_t fileSize = static_cast<uint64_t>(stream.tellg());
+    if (offset > fileSize || (size > 0 && size > fileSize - offset)) {
+        stream.close();
+        return false;
+    }
+    start = offset;
+    byteCount = size > 0 ? size : fileSize - offset;
+    return true;
+}
+
+bool HATFileSource::readAt(uint64_t offset, void* dst, size_t count) {
+    if (!stream.is_open() || !inRange(offset, count, byteCount)) {
+        return false;
+    }
+    stream.clear();
+    stream.seekg(static_cast<std::streamoff>(start + offset));
+    stream.read(static_cast<char*>(dst), count);
+    return static_cast<bool>(stream);
+}
+
+HATMappedSource::HATMappedSource() : mapping(nullptr), mappingSize(0), bytes(nullptr), byteCount(0) {}
+
+HATMappedSource::~HATMappedSource() {
+#ifndef _WIN32
+    if (mapping) {
+        munmap(mapping, mappingSize);
+    }
+#endif
+}
+
+bool HATMappedSource::open(const std::string& filePath, uint64_t offset, uint64_t size) {
+#ifndef _WIN32
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    uint64_t fileSize = 0;
+    if (fstat(fd, &info) == 0) {
+        fileSize = static_cast<uint64_t>(info.st_size);
+    }
+    if (offset >= fileSize || (size > 0 && size > fileSize - offset)) {
+        ::close(fd);
+        return false;
+    }
+    byteCount = size > 0 ? size : fileSize - offset;
+
+    // mmap wants a page aligned offset, so map from the page holding the range
+    uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t mapStart = offset & ~(page - 1);
+    mappingSize = static_cast<size_t>(offset - mapStart + byteCount);
+    void* data = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(mapStart));
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        mappingSize = 0;
+        byteCount = 0;
+        return false;
+    }
+
+    mapping = data;
+    bytes = static_cast<const uint8_t*>(data) + (offset - mapStart);
+    // Playback reads front to back; let the kernel read ahead and drop pages behind
+    madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+    return true;
+#else
+    (void)filePath;
+    (void)offset;
+    (void)size;
+    return false;
+#endif
+}
+
+bool HATMappedSource::readAt(uint64_t offset, void* dst, size_t count) {
+    if (!bytes || !inRange(offset, count, byteCount)) {
+        return false;
+    }
+    if (count > 0) {
+        std::memcpy(dst, bytes + offset, count);
+    }
+    return true;
+}
+
+void HATMappedSource::willNeed(uint64_t offset, uint64_t count) {
+#ifndef _WIN32
+    if (!bytes || !inRange(offset, count, byteCount)) {
+        return;
+    }
+    // Widen to whole pages so the entire range is faulted in at once
+    uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t begin = reinterpret_cast<uintptr_t>(bytes + offset) & ~(page - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(bytes + offset + count);
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+#endif
+}
+
+void HATMappedSource::release(uint64_t offset, uint64_t count) {
+#ifndef _WIN32
+    if (!bytes || !inRange(offset, count, byteCount)) {
+        return;
+    }
+    // Only pages wholly inside the range are dropped, so neighbouring data stays mapped
+    uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t begin = (reinterpret_cast<uintptr_t>(bytes + offset) + page - 1) & ~(page - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(bytes + offset + count) & ~(page - 1);
+    if (end > begin) {
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+    }
+#endif
+}
+
+bool HATCallbackSource::readAt(uint64_t offset, void* dst, size_t count) {
+    if (!readFunction || !inRange(offset, count, byteCount)) {
+        return false;
+    }
+    return readFunction(offset, dst, count) == count;
+}
+
+std::unique_ptr<HATSource> openHATSource(const std::string& filePath, uint64_t offset, uint64_t size) {
+    std::unique_ptr<HATMappedSource> mapped(new HATMappedSource());
+    if (mapped->open(filePath, offset, size)) {
+        return std::unique_ptr<HATSource>(mapped.release());
+    }
+
+    std::unique_ptr<HATFileSource> file(new HATFileSource());
+    if (file->open(filePath, offset, size)) {
+        return std::unique_ptr<HATSource>(file.release());
+    }
+    return std::unique_ptr<HATSource>();
+}
+
+bool HATMemorySink::write(const void* data, size_t count) {
+    const uint8_t* begin = static_cast<const uint8_t*>(data);
+    bytes.insert(bytes.end(), begin, begin + count);
+    return true;
+}
+
+bool HATMemorySink::writeAt(uint64_t offset, const void* data, size_t count) {
+    if (!inRange(offset, count, bytes.size())) {
+        return false;
+    }
+    if (count > 0) {
+        std::memcpy(bytes.data() + offset, data, count);
+    }
+    return true;
+}
+
+HATFileSink::HATFileSink() : position(0), syncFd(-1) {}
+
+HATFileSink::~HATFileSink() {
+#ifndef _WIN32
+    if (syncFd >= 0) {
+        ::close(syncFd);
+    }
+#endif
+}
+
+bool HATFileSink::open(const std::string& path) {
+    filePath = path;
+    position = 0;
+    stream.open(filePath, std::ios::binary);
+    return stream.is_open();
+}
+
+bool HATFileSink::write(const void* data, size_t count) {
+    stream.write(static_cast<const char*>(data), count);
+    position += count;
+    return static_cast<bool>(stream);
+}
+
+bool HATFileSink::writeAt(uint64_t offset, const void* data, size_t count) {
+    if (!inRange(offset, count, position)) {
+        return false;
+    }
+    stream.seekp(static_cast<std::streamoff>(offset));
+    stream.write(static_cast<const char*>(data), count);
+    stream.seekp(static_cast<std::streamoff>(position));
+    return static_cast<bool>(stream);
+}
+
+bool HATFileSink::sync() {
+    stream.flush();
+    if (!stream) {
+        return false;
+    }
+#ifndef _WIN32
+    if (syncFd < 0) {
+        syncFd = ::open(filePath.c_str(), O_WRONLY);
+    }
+    if (syncFd < 0 || ::fsync(syncFd) != 0) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool HATFileSink::close() {
+    if (!stream.is_open()) {
+        return true;
+    }
+    stream.close();
+    return !stream.fail();
+}
+
+bool HATCallbackSink::write(const void* data, size_t count) {
+    if (!writeFunction || !writeFunction(position, data, count)) {
+        return false;
+    }
+    position += count;
+    return true;
+}
+
+bool HATCallbackSink::writeAt(uint64_t offset, const void* data, size_t count) {
+    if (!writeFunction || !inRange(offset, count, position)) {
+        return false;
+    }
+    return writeFunction(offset, data, count);
+}
@@ -0,0 +1,160 @@
+#include "HATMix.h"
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HAT_MIX_SSE2
+#endif
+
+void mixAccumulate(float* acc, const int16_t* src, size_t count, float gain) {
+    size_t i = 0;
+#ifdef HAT_MIX_SSE2
+    // Eight samples per step: widen to int32, convert to float, multiply-add
+    const __m128 scale = _mm_set1_ps(gain);
+    for (; i + 8 <= count; i += 8) {
+        __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128 low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+        __m128 high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16));
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(low, scale)));
+        _mm_storeu_ps(acc + i + 4, _mm_add_ps(_mm_loadu_ps(acc + i + 4), _mm_mul_ps(high, scale)));
+    }
+#endif
+    for (; i < count; ++i) {
+        acc[i] += static_cast<float>(src[i]) * gain;
+    }
+}
+
+void mixStore(int16_t* dst, const float* acc, size_t count) {
+    size_t i = 0;
+#ifdef HAT_MIX_SSE2
+    // Clip before converting, since out of range floats do not convert to int32
+    const __m128 lowest = _mm_set1_ps(-32768.0f);
+    const __m128 highest = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= count; i += 8) {
+        __m128 low = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(acc + i), lowest), highest);
+        __m128 high = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(acc + i + 4), lowest), highest);
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+    }
+#endif
+    for (; i < count; ++i) {
+        float value = std::min(std::max(acc[i], -32768.0f), 32767.0f);
+        dst[i] = static_cast<int16_t>(std::lrint(value));
+    }
+}
+
+float calculateVolume(float x, float y, float z) {
+    float distance = std::sqrt(x * x + y * y + z * z);
+    return 1.0f / (1.0f + distance); // Simple inverse distance attenuation
+}
+
+float calculatePanning(float x) {
+    return x / std::sqrt(x * x + 1); // Normalized panning value
+}
+
+// Which of the left, right and unpanned gains an output channel uses
+static size_t gainIndex(size_t outChannel, size_t outChannels) {
+    if (outChannels == 1 || outChannel > 1) {
+        return 2;
+    }
+    return outChannel;
+}
+
+HATSourceGain::HATSourceGain() : gain(1.0f) {
+    position[0] = 0.0f;
+    position[1] = 0.0f;
+    position[2] = 0.0f;
+    update();
+    snap();
+}
+
+void HATSourceGain::setPosition(float x, float y, float z) {
+    if (x == position[0] && y == position[1] && z == position[2]) {
+        return;
+    }
+    position[0] = x;
+    position[1] = y;
+    position[2] = z;
+    update();
+}
+
+void HATSourceGain::setGain(float gain) {
+    if (gain == this->gain) {
+        return;
+    }
+    this->gain = gain;
+    update();
+}
+
+void HATSourceGain::snap() {
+    std::copy(target, target + 3, current);
+}
+
+void HATSourceGain::update() {
+    float volume = calculateVolume(position[0], position[1], position[2]) * gain;
+    float panning = calculatePanning(position[0]);
+    target[0] = volume * (1.0f - panning);
+    target[1] = volume * (1.0f + panning);
+    target[2] = volume;
+}
+
+void HATSourceGain::mix(float* acc, size_t outChannels, const int16_t* src, size_t channels, size_t frames) {
+    if (frames == 0 || outChannels == 0 || channels == 0) {
+        return;
+    }
+
+    float step[3];
+    for (size_t k = 0; k < 3; ++k) {
+        step[k] = (target[k] - current[k]) / static_cast<float>(frames);
+    }
+
+    size_t f = 0;
+#ifdef HAT_MIX_SSE2
+    // Mono or stereo onto stereo, four frames per step. The gains are kept as
+    // L R L R for two frames and advanced two frames at a time.
+    if (outChannels == 2 && channels <= 2) {
+        __m128 gains = _mm_setr_ps(current[0], current[1], current[0] + step[0], current[1] + step[1]);
+        const __m128 gainStep = _mm_setr_ps(2.0f * step[0], 2.0f * step[1], 2.0f * step[0], 2.0f * step[1]);
+        for (; f + 4 <= frames; f += 4) {
+            __m128 first;
+            __m128 second;
+            if (channels == 1) {
+                __m128i samples = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + f));
+                __m128 mono = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+                first = _mm_unpacklo_ps(mono, mono);
+                second = _mm_unpackhi_ps(mono, mono);
+            } else {
+                __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + f * 2));
+                first = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+                second = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16));
+            }
+
+            float* out = acc + f * 2;
+            _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), _mm_mul_ps(first, gains)));
+            gains = _mm_add_ps(gains, gainStep);
+            _mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_mul_ps(second, gains)));
+            gains = _mm_add_ps(gains, gainStep);
+        }
+    }
+#endif
+
+    const int16_t* in = src + f * channels;
+    float* out = acc + f * outChannels;
+    for (; f < frames; ++f, in += channels, out += outChannels) {
+        float offset = static_cast<float>(f);
+        if (channels >= outChannels) {
+            for (size_t c = 0; c < channels; ++c) {
+                size_t o = c % outChannels;
+                size_t k = gainIndex(o, outChannels);
+                out[o] += static_cast<float>(in[c]) * (current[k] + step[k] * offset);
+            }
+        } else {
+            for (size_t o = 0; o < outChannels; ++o) {
+                size_t k = gainIndex(o, outChannels);
+                out[o] += static_cast<float>(in[o % channels]) * (current[k] + step[k] * offset);
+            }
+        }
+    }
+
+    snap();
+}
@@ -0,0 +1,418 @@
+#include "HATMixer.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+
+// Blocks of decoded audio buffered per voice
+const size_t VOICE_RING_BLOCKS = 2;
+
+HATMixer::Voice::Voice()
+    : state(VOICE_FREE), generation(0), channels(0), loop(false), level(1.0f), paused(false), stopRequested(false), decodeFinished(false),
+      cursor(0), frameCount(0), isVirtual(false), virtualFlag(false), seekFrame(0), seekRequest(0), seekServed(0), segmentStart(0),
+      samplesWritten(0), samplesRead(0), resumeFrame(0), skipFrames(0), resyncing(false), resampling(false), tailPadding(0) {
+    position[0] = 0.0f;
+    position[1] = 0.0f;
+    position[2] = 0.0f;
+}
+
+HATMixer::HATMixer(uint32_t maxVoices, int sampleRate, int outChannels, ResampleQuality quality)
+    : sampleRate(sampleRate), outChannels(outChannels), quality(quality), underruns(0), virtualThreshold(HAT_VIRTUAL_THRESHOLD), running(true) {
+    voices.reserve(maxVoices);
+    for (uint32_t i = 0; i < maxVoices; ++i) {
+        voices.push_back(std::unique_ptr<Voice>(new Voice()));
+    }
+    bus.resize(static_cast<size_t>(HAT_BLOCK_FRAMES) * outChannels);
+    decodeThread = std::thread(&HATMixer::decodeLoop, this);
+}
+
+HATMixer::~HATMixer() {
+    running = false;
+    decodeThread.join();
+}
+
+HATVoice HATMixer::play(const std::string& inputFilePath, float x, float y, float z, float gain, bool loop) {
+    std::unique_ptr<HATDecoder> decoder(new HATDecoder(inputFilePath));
+    if (!decoder->open()) {
+        return HAT_INVALID_VOICE;
+    }
+    return play(std::move(decoder), x, y, z, gain, loop);
+}
+
+HATVoice HATMixer::play(std::unique_ptr<HATDecoder> decoder, float x, float y, float z, float gain, bool loop) {
+    // Opening again would lose the caller's seek, so only open a fresh decoder
+    if (!decoder || (!decoder->isOpen() && !decoder->open())) {
+        return HAT_INVALID_VOICE;
+    }
+
+    uint32_t index = 0;
+    for (; index < voices.size(); ++index) {
+        int expected = VOICE_FREE;
+        if (voices[index]->state.compare_exchange_strong(expected, VOICE_STARTING)) {
+            break;
+        }
+    }
+    if (index == voices.size()) {
+        std::cerr << "\033[31m All " << voices.size() << " voices are in use." << std::endl << "\033[39m";
+        return HAT_INVALID_VOICE;
+    }
+
+    // Nothing else touches a starting voice, so it can be set up here,
+    // allocations included
+    Voice& voice = *voices[index];
+    voice.channels = decoder->getChannels();
+    voice.loop = loop;
+    voice.decoder = std::move(decoder);
+    size_t blockSamples = static_cast<size_t>(HAT_BLOCK_FRAMES) * voice.channels;
+    // A file at a higher rate than the mixer's is read proportionally faster
+    size_t ringSamples = VOICE_RING_BLOCKS * blockSamples * ((voice.decoder->getSampleRate() + sampleRate - 1) / sampleRate);
+    if (!voice.ring || voice.ring->capacity() < ringSamples) {
+        voice.ring.reset(new HATRingBuffer<int16_t>(ringSamples));
+    }
+    voice.buffer.resize(blockSamples);
+    voice.resampling = voice.decoder->getSampleRate() != sampleRate;
+    if (voice.resampling) {
+        voice.resampler.setup(voice.decoder->getSampleRate(), sampleRate, static_cast<int>(voice.channels), quality, HAT_BLOCK_FRAMES);
+        voice.resampled.resize(blockSamples);
+    }
+    voice.tailPadding = voice.resampling ? voice.resampler.getTaps() : 0;
+    voice.position[0] = x;
+    voice.position[1] = y;
+    voice.position[2] = z;
+    voice.level = gain;
+    voice.paused = false;
+    voice.stopRequested = false;
+    voice.decodeFinished = false;
+    voice.gain.setPosition(x, y, z);
+    voice.gain.setGain(gain);
+    voice.gain.snap();
+    voice.cursor = voice.decoder->getPosition();
+    voice.frameCount = voice.decoder->getFrameCount();
+    voice.seekRequest = 0;
+    voice.seekServed = 0;
+    voice.segmentStart = 0;
+    voice.samplesWritten = 0;
+    voice.samplesRead = 0;
+    voice.skipFrames = 0;
+    voice.resyncing = false;
+
+    // A voice that starts out inaudible is not decoded until it is heard
+    voice.isVirtual = voice.gain.getLevel() < virtualThreshold.load();
+    voice.virtualFlag = voice.isVirtual;
+    if (!voice.isVirtual) {
+        std::vector<int16_t> block;
+        fillVoice(voice, block);
+    }
+
+    uint32_t generation = voice.generation.load() + 1;
+    voice.generation.store(generation);
+    voice.state.store(VOICE_PLAYING, std::memory_order_release);
+    return (static_cast<uint64_t>(generation) << 32) | index;
+}
+
+HATMixer::Voice* HATMixer::findVoice(HATVoice voice) const {
+    uint32_t index = static_cast<uint32_t>(voice & 0xFFFFFFFFu);
+    uint32_t generation = static_cast<uint32_t>(voice >> 32);
+    if (voice == HAT_INVALID_VOICE || index >= voices.size() || voices[index]->generation.load() != generation) {
+        return nullptr;
+    }
+    return voices[index].get();
+}
+
+void HATMixer::stop(HATVoice voice) {
+    Voice* target = findVoice(voice);
+    if (target) {
+        target->stopRequested = true;
+    }
+}
+
+void HATMixer::setPosition(HATVoice voice, float x, float y, float z) {
+    Voice* target = findVoice(voice);
+    if (target) {
+        target->position[0].store(x, std::memory_order_relaxed);
+        target->position[1].store(y, std::memory_order_relaxed);
+        target->position[2].store(z, std::memory_order_relaxed);
+    }
+}
+
+void HATMixer::setGain(HATVoice voice, float gain) {
+    Voice* target = findVoice(voice);
+    if (target) {
+        target->level.store(gain, std::memory_order_relaxed);
+    }
+}
+
+void HATMixer::setPaused(HATVoice voice, bool paused) {
+    Voice* target = findVoice(voice);
+    if (target) {
+        target->paused = paused;
+    }
+}
+
+bool HATMixer::isPlaying(HATVoice voice) const {
+    Voice* target = findVoice(voice);
+    return target && target->state.load() == VOICE_PLAYING && !target->stopRequested.load();
+}
+
+uint32_t HATMixer::getVirtualVoices() const {
+    uint32_t virtualVoices = 0;
+    for (size_t i = 0; i < voices.size(); ++i) {
+        virtualVoices += voices[i]->state.load(std::memory_order_relaxed) == VOICE_PLAYING && voices[i]->virtualFlag.load(std::memory_order_relaxed);
+    }
+    return virtualVoices;
+}
+
+uint32_t HATMixer::getActiveVoices() const {
+    uint32_t active = 0;
+    for (size_t i = 0; i < voices.size(); ++i) {
+        active += voices[i]->state.load(std::memory_order_relaxed) == VOICE_PLAYING;
+    }
+    return active;
+}
+
+void HATMixer::mix(int16_t* output, size_t frames) {
+    size_t done = 0;
+    while (done < frames) {
+        size_t chunk = std::min(frames - done, static_cast<size_t>(HAT_BLOCK_FRAMES));
+        std::fill(bus.begin(), bus.begin() + chunk * outChannels, 0.0f);
+
+        for (size_t i = 0; i < voices.size(); ++i) {
+            Voice& voice = *voices[i];
+            if (voice.state.load(std::memory_order_acquire) != VOICE_PLAYING) {
+                continue;
+            }
+            if (voice.stopRequested.load(std::memory_order_relaxed)) {
+                voice.state.store(VOICE_RELEASING, std::memory_order_release);
+                continue;
+            }
+
+            voice.gain.setPosition(voice.position[0].load(std::memory_order_relaxed),
+                                   voice.position[1].load(std::memory_order_relaxed),
+                                   voice.position[2].load(std::memory_order_relaxed));
+            voice.gain.setGain(voice.level.load(std::memory_order_relaxed));
+            if (!voice.paused.load(std::memory_order_relaxed)) {
+                mixVoice(voice, chunk);
+            }
+        }
+
+        mixStore(output + done * outChannels, bus.data(), chunk * outChannels);
+        done += chunk;
+    }
+}
+
+// Moves a cursor on by `frames`, wrapping around a looping track
+static void moveCursor(uint64_t& cursor, uint64_t frames, uint64_t frameCount, bool loop) {
+    cursor += frames;
+    if (loop && frameCount > 0 && cursor >= frameCount) {
+        cursor %= frameCount;
+    }
+}
+
+// Source frames that play in `frames` output frames
+static uint64_t toSourceFrames(HATResampler& resampler, bool resampling, size_t frames) {
+    return resampling ? resampler.advance(frames) : frames;
+}
+
+void HATMixer::mixVoice(Voice& voice, size_t frames) {
+    if (voice.gain.getLevel() < virtualThreshold.load(std::memory_order_relaxed)) {
+        if (!voice.isVirtual) {
+            voice.isVirtual = true;
+            voice.virtualFlag.store(true, std::memory_order_relaxed);
+            // The resampler has read a little further than has been heard
+            uint64_t buffered = voice.resampling ? voice.resampler.getBufferedFrames() : 0;
+            if (voice.loop && voice.frameCount > 0) {
+                voice.cursor = (voice.cursor + voice.frameCount - buffered % voice.frameCount) % voice.frameCount;
+            } else {
+                voice.cursor -= std::min(buffered, voice.cursor);
+            }
+            advanceVoice(voice, voice.skipFrames);
+            voice.skipFrames = 0;
+        }
+        advanceVoice(voice, toSourceFrames(voice.resampler, voice.resampling, frames));
+        return;
+    }
+
+    if (voice.isVirtual) {
+        // Audible again: have the decode thread restart where the voice is now
+        voice.isVirtual = false;
+        voice.virtualFlag.store(false, std::memory_order_relaxed);
+        voice.resampler.reset();
+        voice.tailPadding = voice.resampler.getTaps();
+        voice.resyncing = true;
+        voice.resumeFrame = voice.cursor;
+        voice.seekFrame.store(voice.cursor, std::memory_order_relaxed);
+        voice.seekRequest.store(voice.seekRequest.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    if (!catchUp(voice, frames)) {
+        return;
+    }
+    if (voice.resampling) {
+        mixResampled(voice, frames);
+        return;
+    }
+
+    // Checked before reading, so a voice is only released once everything
+    // the decode thread wrote has been played
+    bool finished = voice.decodeFinished.load(std::memory_order_acquire);
+    size_t read = voice.ring->read(voice.buffer.data(), frames * voice.channels) / voice.channels;
+    voice.samplesRead += read * voice.channels;
+    moveCursor(voice.cursor, read, voice.frameCount, voice.loop);
+    voice.gain.mix(bus.data(), outChannels, voice.buffer.data(), voice.channels, read);
+    if (read < frames) {
+        if (finished) {
+            voice.state.store(VOICE_RELEASING, std::memory_order_release);
+        } else {
+            underruns++;
+        }
+    }
+}
+
+// Once the decode thread has seeked a resumed voice, drops the audio it
+// buffered before the seek and the frames that played while it was seeking.
+// Returns false while the voice is still catching up.
+bool HATMixer::catchUp(Voice& voice, size_t frames) {
+    if (voice.resyncing) {
+        if (voice.seekServed.load(std::memory_order_acquire) != voice.seekRequest.load(std::memory_order_relaxed)) {
+            advanceVoice(voice, toSourceFrames(voice.resampler, voice.resampling, frames));
+            return false;
+        }
+        voice.resyncing = false;
+
+        // Written before the seek, so already in the ring
+        uint64_t stale = voice.segmentStart.load(std::memory_order_relaxed) - voice.samplesRead;
+        while (stale > 0) {
+            size_t read = voice.ring->read(voice.buffer.data(), static_cast<size_t>(std::min<uint64_t>(stale, voice.buffer.size())));
+            if (read == 0) {
+                break;
+            }
+            stale -= read;
+            voice.samplesRead += read;
+        }
+
+        uint64_t behind = voice.cursor + (voice.cursor < voice.resumeFrame ? voice.frameCount : 0) - voice.resumeFrame;
+        voice.skipFrames = behind;
+        voice.cursor = voice.resumeFrame;
+    }
+
+    bool finished = voice.decodeFinished.load(std::memory_order_acquire);
+    size_t bufferFrames = voice.buffer.size() / voice.channels;
+    while (voice.skipFrames > 0) {
+        size_t wanted = static_cast<size_t>(std::min<uint64_t>(voice.skipFrames, bufferFrames));
+        size_t read = voice.ring->read(voice.buffer.data(), wanted * voice.channels) / voice.channels;
+        if (read == 0) {
+            break;
+        }
+        voice.skipFrames -= read;
+        voice.samplesRead += read * voice.channels;
+        moveCursor(voice.cursor, read, voice.frameCount, voice.loop);
+    }
+    if (voice.skipFrames > 0) {
+        if (finished) {
+            voice.state.store(VOICE_RELEASING, std::memory_order_release);
+        } else {
+            voice.skipFrames += toSourceFrames(voice.resampler, voice.resampling, frames);
+        }
+        return false;
+    }
+    return true;
+}
+
+// Mixes a voice whose sample rate differs from the mixer's, pulling from the
+// ring only as many frames as the resampler needs
+void HATMixer::mixResampled(Voice& voice, size_t frames) {
+    bool finished = voice.decodeFinished.load(std::memory_order_acquire);
+    size_t bufferFrames = voice.buffer.size() / voice.channels;
+    size_t done = 0;
+    while (done < frames) {
+        size_t needed = std::min(voice.resampler.getInputNeeded(frames - done), std::min(bufferFrames, voice.resampler.getSpace()));
+        size_t read = voice.ring->read(voice.buffer.data(), needed * voice.channels) / voice.channels;
+        voice.samplesRead += read * voice.channels;
+        moveCursor(voice.cursor, read, voice.frameCount, voice.loop);
+        if (read < needed && finished) {
+            // Silence after the end of the track lets its last frames through the filter
+            size_t padding = std::min(needed - read, voice.tailPadding);
+            std::fill(voice.buffer.begin() + read * voice.channels, voice.buffer.begin() + (read + padding) * voice.channels, static_cast<int16_t>(0));
+            read += padding;
+            voice.tailPadding -= padding;
+        }
+        voice.resampler.write(voice.buffer.data(), read);
+
+        size_t produced = voice.resampler.read(voice.resampled.data(), frames - done);
+        if (produced == 0) {
+            break;
+        }
+        voice.gain.mix(bus.data() + done * outChannels, outChannels, voice.resampled.data(), voice.channels, produced);
+        done += produced;
+    }
+
+    if (done < frames) {
+        if (finished && voice.tailPadding == 0) {
+            voice.state.store(VOICE_RELEASING, std::memory_order_release);
+        } else {
+            underruns++;
+        }
+    }
+}
+
+// Keeps time for a voice that is not being heard
+void HATMixer::advanceVoice(Voice& voice, size_t frames) {
+    moveCursor(voice.cursor, frames, voice.frameCount, voice.loop);
+    if (!voice.loop && voice.cursor >= voice.frameCount) {
+        voice.state.store(VOICE_RELEASING, std::memory_order_release);
+    }
+}
+
+bool HATMixer::fillVoice(Voice& voice, std::vector<int16_t>& block) {
+    size_t blockSamples = static_cast<size_t>(HAT_BLOCK_FRAMES) * voice.channels;
+    if (voice.ring->space() < blockSamples) {
+        return false;
+    }
+    if (block.size() < blockSamples) {
+        block.resize(blockSamples);
+    }
+
+    size_t frames = voice.decoder->read(block.data(), HAT_BLOCK_FRAMES);
+    if (frames == 0 && voice.loop && voice.decoder->getFrameCount() > 0 && voice.decoder->seek(0)) {
+        frames = voice.decoder->read(block.data(), HAT_BLOCK_FRAMES);
+    }
+    if (frames == 0) {
+        voice.decodeFinished.store(true, std::memory_order_release);
+        return false;
+    }
+    voice.ring->write(block.data(), frames * voice.channels);
+    voice.samplesWritten += frames * voice.channels;
+    return true;
+}
+
+void HATMixer::decodeLoop() {
+    while (running.load()) {
+        bool decoded = false;
+        for (size_t i = 0; i < voices.size(); ++i) {
+            Voice& voice = *voices[i];
+            int state = voice.state.load(std::memory_order_acquire);
+            if (state == VOICE_RELEASING) {
+                // mix() no longer reads the ring, so it can be emptied from here.
+                // The decoder is freed on this thread, never the audio thread.
+                voice.ring->clear();
+                voice.decoder.reset();
+                voice.state.store(VOICE_FREE, std::memory_order_release);
+            } else if (state == VOICE_PLAYING) {
+                uint32_t request = voice.seekRequest.load(std::memory_order_acquire);
+                if (request != voice.seekServed.load(std::memory_order_relaxed)) {
+                    // A virtual voice became audible; restart where it is now
+                    bool seeked = voice.decoder->seek(voice.seekFrame.load(std::memory_order_relaxed));
+                    voice.decodeFinished.store(!seeked, std::memory_order_relaxed);
+                    voice.segmentStart.store(voice.samplesWritten, std::memory_order_relaxed);
+                    voice.seekServed.store(request, std::memory_order_release);
+                }
+                // Virtual voices are not decoded at all
+                if (!voice.virtualFlag.load(std::memory_order_relaxed) && !voice.decodeFinished.load(std::memory_order_relaxed)) {
+                    decoded = fillVoice(voice, decodeBlock) || decoded;
+                }
+            }
+        }
+
+        if (!decoded) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+}
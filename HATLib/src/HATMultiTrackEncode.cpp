@@ -0,0 +1,144 @@
+#include "HATMultiTrackEncode.h"
+#include <iostream>
+#include <algorithm>
+
+HATMultiTrackEncoder::HATMultiTrackEncoder(const std::string& outputFilePath, uint32_t trackCount, const std::unordered_map<std::string, std::string>& metadata)
+    : outputFilePath(outputFilePath), sink(nullptr), header(), trackInfo(), trackCount(trackCount), isOpen(false), finalized(false) {
+    // The fixed fields describe the first track, so tools that only read the
+    // header still show a sensible format and duration
+    header.version = HAT_VERSION;
+    header.spatialData[0] = 0.0f;
+    header.spatialData[1] = 0.0f;
+    header.spatialData[2] = 0.0f;
+    header.compressionMethod = LOSSLESS;
+    header.tracks = static_cast<uint8_t>(std::min<uint32_t>(trackCount, UINT8_MAX));
+    header.blockFrames = HAT_BLOCK_FRAMES;
+
+    trackInfo.metadata.insert(metadata.begin(), metadata.end());
+    trackInfo.metadata.insert(std::make_pair("artist", "Unknown Artist"));
+    trackInfo.metadata.insert(std::make_pair("description", "No Description"));
+    trackInfo.metadata.insert(std::make_pair("trackName", "Unknown Track"));
+    trackInfo.trackNumber = 0;
+    tracks.reserve(trackCount);
+}
+
+HATMultiTrackEncoder::HATMultiTrackEncoder(HATSink& sink, uint32_t trackCount, const std::unordered_map<std::string, std::string>& metadata)
+    : HATMultiTrackEncoder(std::string(), trackCount, metadata) {
+    this->sink = &sink;
+}
+
+bool HATMultiTrackEncoder::open() {
+    if (isOpen) {
+        return true;
+    }
+    if (trackCount == 0) {
+        std::cerr << "Error: A multi-track file needs at least one track." << std::endl;
+        return false;
+    }
+    uint64_t metadataSize = static_cast<uint64_t>(getMetadataChunkSize(trackInfo.metadata)) + HAT_METADATA_PADDING;
+    if (metadataSize > HAT_MAX_METADATA_SIZE) {
+        std::cerr << "Error: The metadata is larger than " << HAT_MAX_METADATA_SIZE << " bytes." << std::endl;
+        return false;
+    }
+    header.metadataSize = static_cast<uint32_t>(metadataSize);
+
+    if (!sink) {
+        ownedSink.reset(new HATFileSink());
+        if (!ownedSink->open(outputFilePath)) {
+            std::cerr << "Error opening output file." << std::endl;
+            ownedSink.reset();
+            return false;
+        }
+        sink = ownedSink.get();
+    }
+
+    // The directory is written empty and patched by finalize()
+    if (!writeHeaders(false)) {
+        std::cerr << "Error writing output file." << std::endl;
+        return false;
+    }
+    isOpen = true;
+    return true;
+}
+
+HATStreamEncoder* HATMultiTrackEncoder::addTrack(int sampleRate, int bitRate, int audioChannels, const std::unordered_map<std::string, std::string>& metadata) {
+    if (finalized || !open() || !endTrack()) {
+        return nullptr;
+    }
+    if (tracks.size() == trackCount) {
+        std::cerr << "Error: The file was created for " << trackCount << " tracks." << std::endl;
+        return nullptr;
+    }
+
+    if (tracks.empty()) {
+        header.channels = static_cast<uint8_t>(audioChannels);
+        header.sampleRate = sampleRate;
+        header.bitRate = bitRate;
+    }
+
+    TrackDirectoryEntry track;
+    track.offset = sink->tell() - getDataOffset(header);
+    track.size = 0; // Known once the track is complete
+    tracks.push_back(track);
+
+    trackSink.reset(new HATRangeSink(*sink));
+    trackEncoder.reset(new HATStreamEncoder(*trackSink, sampleRate, bitRate, audioChannels, metadata));
+    trackEncoder->setTrackNumber(static_cast<int>(tracks.size()));
+    return trackEncoder.get();
+}
+
+bool HATMultiTrackEncoder::endTrack() {
+    if (!trackEncoder) {
+        return true;
+    }
+
+    bool completed = trackEncoder->finalize();
+    tracks.back().size = trackSink->tell();
+    if (tracks.size() == 1) {
+        header.length = trackEncoder->getFramesWritten() * header.channels;
+        header.compressionRatio = trackEncoder->getCompressionRatio();
+    }
+
+    trackEncoder.reset();
+    trackSink.reset();
+    return completed;
+}
+
+bool HATMultiTrackEncoder::finalize() {
+    if (finalized) {
+        return true;
+    }
+    if (!open() || !endTrack()) {
+        return false;
+    }
+    if (tracks.size() != trackCount) {
+        std::cerr << "Error: Only " << tracks.size() << " of " << trackCount << " tracks were written." << std::endl;
+        return false;
+    }
+
+    header.datalength = sink->tell() - getDataOffset(header);
+    bool written = writeHeaders(true);
+    written = sink->close() && written;
+
+    finalized = true;
+    if (!written) {
+        std::cerr << "Error writing output file." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool HATMultiTrackEncoder::writeHeaders(bool patch) {
+    // Tracks not written yet keep an empty entry, so the directory has its final size
+    std::vector<TrackDirectoryEntry> entries(tracks);
+    entries.resize(trackCount, TrackDirectoryEntry());
+    std::vector<uint8_t> directory = packTrackDirectory(entries);
+
+    std::vector<uint8_t> bytes(HAT_HEADER_SIZE + header.metadataSize);
+    packHATHeader(header, trackInfo, bytes.data());
+    if (!packMetadata(trackInfo.metadata, bytes.data() + HAT_HEADER_SIZE, header.metadataSize)) {
+        return false;
+    }
+    bytes.insert(bytes.end(), directory.begin(), directory.end());
+    return patch ? sink->writeAt(0, bytes.data(), bytes.size()) : sink->write(bytes.data(), bytes.size());
+}
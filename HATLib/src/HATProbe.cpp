@@ -0,0 +1,101 @@
+#include "HATProbe.h"
+#include <iostream>
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// The first read covers the header and the metadata of almost every file
+const size_t PROBE_READ_SIZE = 4096;
+
+HATProbe::HATProbe() : header(), trackInfo() {}
+
+bool HATProbe::open(const std::string& filePath) {
+    buffer.resize(PROBE_READ_SIZE);
+    size_t bytesRead = 0;
+    size_t needed = 0;
+#ifndef _WIN32
+    // A bare descriptor and pread keep the cost per file to three syscalls
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "\033[31m Error opening input file: " << filePath << std::endl << "\033[39m";
+        return false;
+    }
+    ssize_t result = ::pread(fd, buffer.data(), buffer.size(), 0);
+    bytesRead = result > 0 ? static_cast<size_t>(result) : 0;
+    if (bytesRead >= HAT_HEADER_SIZE && parseHeader()) {
+        needed = HAT_HEADER_SIZE + header.metadataSize;
+        if (needed > bytesRead) {
+            buffer.resize(needed);
+            result = ::pread(fd, buffer.data() + bytesRead, needed - bytesRead, static_cast<off_t>(bytesRead));
+            bytesRead += result > 0 ? static_cast<size_t>(result) : 0;
+        }
+    }
+    ::close(fd);
+#else
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "\033[31m Error opening input file: " << filePath << std::endl << "\033[39m";
+        return false;
+    }
+    file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+    bytesRead = static_cast<size_t>(file.gcount());
+    if (bytesRead >= HAT_HEADER_SIZE && parseHeader()) {
+        needed = HAT_HEADER_SIZE + header.metadataSize;
+        if (needed > bytesRead) {
+            buffer.resize(needed);
+            file.clear();
+            file.read(reinterpret_cast<char*>(buffer.data() + bytesRead), needed - bytesRead);
+            bytesRead += static_cast<size_t>(file.gcount());
+        }
+    }
+#endif
+
+    if (bytesRead < HAT_HEADER_SIZE) {
+        std::cerr << "\033[31m File too small to contain a valid header: " << filePath << std::endl << "\033[39m";
+        return false;
+    }
+    if (needed == 0) {
+        return false; // parseHeader() has already said why
+    }
+    if (bytesRead < needed) {
+        std::cerr << "\033[31m Metadata chunk is truncated: " << filePath << std::endl << "\033[39m";
+        return false;
+    }
+    return unpackMetadata(buffer.data() + HAT_HEADER_SIZE, header.metadataSize, trackInfo.metadata);
+}
+
+bool HATProbe::open(HATSource& source) {
+    buffer.resize(HAT_HEADER_SIZE);
+    if (!source.readAt(0, buffer.data(), HAT_HEADER_SIZE)) {
+        std::cerr << "\033[31m File too small to contain a valid header." << std::endl << "\033[39m";
+        return false;
+    }
+    if (!parseHeader()) {
+        return false;
+    }
+
+    if (header.metadataSize > source.size() - HAT_HEADER_SIZE) {
+        std::cerr << "\033[31m Metadata chunk is truncated." << std::endl << "\033[39m";
+        return false;
+    }
+    buffer.resize(HAT_HEADER_SIZE + header.metadataSize);
+    if (!source.readAt(HAT_HEADER_SIZE, buffer.data() + HAT_HEADER_SIZE, header.metadataSize)) {
+        std::cerr << "\033[31m Metadata chunk is truncated." << std::endl << "\033[39m";
+        return false;
+    }
+    return unpackMetadata(buffer.data() + HAT_HEADER_SIZE, header.metadataSize, trackInfo.metadata);
+}
+
+bool HATProbe::parseHeader() {
+    if (!unpackHATHeader(buffer.data(), header, trackInfo)) {
+        return false;
+    }
+    if (header.channels == 0 || header.blockFrames == 0) {
+        std::cerr << "\033[31m Invalid header! The file has no channels or no block size." << std::endl << "\033[39m";
+        return false;
+    }
+    return true;
+}
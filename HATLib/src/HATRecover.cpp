@@ -0,0 +1,248 @@
+#include "HATRecover.h"
+#include "HATFormat.h"
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+static bool truncateFile(const std::string& filePath, uint64_t size) {
+#ifdef _WIN32
+    int fd = _open(filePath.c_str(), _O_WRONLY | _O_BINARY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = _chsize_s(fd, static_cast<__int64>(size)) == 0;
+    _close(fd);
+    return ok;
+#else
+    return ::truncate(filePath.c_str(), static_cast<off_t>(size)) == 0;
+#endif
+}
+
+// Reads and validates the checkpoint at `offset`. On success the seek index
+// state it describes is returned along with the offset just past it.
+static bool readCheckpoint(std::fstream& file, uint64_t offset, uint64_t fileSize, std::vector<uint64_t>& coarseIndex, std::vector<uint64_t>& pageOffsets, uint64_t& blockCount, uint64_t& checkpointEnd) {
+    CheckpointHeader checkpoint;
+    if (offset + HAT_CHECKPOINT_HEADER_SIZE > fileSize) {
+        return false;
+    }
+
+    std::vector<uint8_t> record(HAT_CHECKPOINT_HEADER_SIZE);
+    file.clear();
+    file.seekg(offset);
+    file.read(reinterpret_cast<char*>(record.data()), record.size());
+    if (!file) {
+        return false;
+    }
+    unpackCheckpointHeader(record.data(), checkpoint);
+
+    if (checkpoint.sync != HAT_CHECKPOINT_SYNC || checkpoint.pageEntries != HAT_SEEK_PAGE_ENTRIES ||
+        checkpoint.partialCount >= checkpoint.pageEntries ||
+        checkpoint.blockCount != static_cast<uint64_t>(checkpoint.pageCount) * checkpoint.pageEntries + checkpoint.partialCount) {
+        return false;
+    }
+
+    uint64_t entries = static_cast<uint64_t>(checkpoint.pageCount) + checkpoint.partialCount;
+    uint64_t size = HAT_CHECKPOINT_HEADER_SIZE + entries * sizeof(uint64_t) + sizeof(uint32_t);
+    if (offset + size > fileSize) {
+        return false;
+    }
+
+    record.resize(static_cast<size_t>(size));
+    file.read(reinterpret_cast<char*>(record.data() + HAT_CHECKPOINT_HEADER_SIZE), record.size() - HAT_CHECKPOINT_HEADER_SIZE);
+    if (!file || calculateCRC32(record.data(), record.size() - sizeof(uint32_t)) != unpackU32(record.data() + record.size() - sizeof(uint32_t))) {
+        return false;
+    }
+
+    const uint8_t* offsets = record.data() + HAT_CHECKPOINT_HEADER_SIZE;
+    coarseIndex.resize(checkpoint.pageCount);
+    unpackOffsets(offsets, coarseIndex.size(), coarseIndex.data());
+    pageOffsets.resize(checkpoint.partialCount);
+    unpackOffsets(offsets + coarseIndex.size() * sizeof(uint64_t), pageOffsets.size(), pageOffsets.data());
+    blockCount = checkpoint.blockCount;
+    checkpointEnd = offset + size;
+    return true;
+}
+
+// Scans backwards from the end of the file for the last intact checkpoint.
+static bool findLastCheckpoint(std::fstream& file, uint64_t dataStart, uint64_t fileSize, std::vector<uint64_t>& coarseIndex, std::vector<uint64_t>& pageOffsets, uint64_t& blockCount, uint64_t& checkpointEnd) {
+    const uint64_t windowSize = 64 * 1024;
+    std::vector<uint8_t> window;
+
+    uint64_t end = fileSize;
+    while (end > dataStart) {
+        uint64_t begin = end - dataStart > windowSize ? end - windowSize : dataStart;
+        // Overlap the next window by three bytes so sync words split between windows are found
+        uint64_t readEnd = std::min(end + 3, fileSize);
+
+        window.resize(static_cast<size_t>(readEnd - begin));
+        file.clear();
+        file.seekg(begin);
+        file.read(reinterpret_cast<char*>(window.data()), window.size());
+        if (!file) {
+            return false;
+        }
+
+        for (size_t i = window.size() >= 4 ? window.size() - 4 + 1 : 0; i-- > 0;) {
+            if (unpackU32(window.data() + i) == HAT_CHECKPOINT_SYNC && readCheckpoint(file, begin + i, fileSize, coarseIndex, pageOffsets, blockCount, checkpointEnd)) {
+                return true;
+            }
+        }
+        end = begin;
+    }
+    return false;
+}
+
+bool recoverHATFile(const std::string& filePath) {
+    std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "\033[31m Error opening input file." << std::endl << "\033[39m";
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    HATHeader header;
+    TrackInfo trackInfo;
+    if (!readHATHeader(file, header, trackInfo) || header.channels == 0 || header.blockFrames == 0) {
+        std::cerr << "\033[31m Not a recoverable HAT file: the header itself is damaged or from another version." << std::endl << "\033[39m";
+        return false;
+    }
+
+    // A finalized file has a seek marker pointing at the coarse seek index
+    uint64_t dataStart = getDataOffset(header);
+    uint8_t sync[sizeof(uint32_t)];
+    if (trackInfo.seekMarker != 0 && dataStart + trackInfo.seekMarker + HAT_INDEX_HEADER_SIZE <= fileSize) {
+        file.seekg(dataStart + trackInfo.seekMarker);
+        file.read(reinterpret_cast<char*>(sync), sizeof(sync));
+        if (file && unpackU32(sync) == HAT_INDEX_SYNC) {
+            std::cout << "File is already complete, nothing to recover." << std::endl;
+            return true;
+        }
+    }
+
+    // Multi-track files are written in one go and are never recorded live
+    file.seekg(dataStart);
+    file.read(reinterpret_cast<char*>(sync), sizeof(sync));
+    if (file && unpackU32(sync) == HAT_TRACK_SYNC) {
+        std::cerr << "\033[31m Multi-track files cannot be recovered." << std::endl << "\033[39m";
+        return false;
+    }
+    file.clear();
+
+    // Offsets in the seek index are relative to dataStart; `position` is absolute
+    std::vector<uint64_t> coarseIndex;
+    std::vector<uint64_t> pageOffsets;
+    uint64_t blockCount = 0;
+    uint64_t position = dataStart;
+    if (!findLastCheckpoint(file, dataStart, fileSize, coarseIndex, pageOffsets, blockCount, position)) {
+        coarseIndex.clear();
+        pageOffsets.clear();
+        blockCount = 0;
+        position = dataStart;
+    }
+
+    // Every block before a checkpoint is full; walk the blocks and pages written after it
+    uint64_t frames = blockCount * header.blockFrames;
+    std::vector<uint8_t> payload;
+    uint8_t record[HAT_BLOCK_HEADER_SIZE];
+    bool lastBlockSeen = false;
+    while (!lastBlockSeen && position + sizeof(uint32_t) <= fileSize) {
+        file.clear();
+        file.seekg(position);
+        file.read(reinterpret_cast<char*>(record), sizeof(uint32_t));
+        uint32_t recordSync = file ? unpackU32(record) : 0;
+
+        if (recordSync == HAT_BLOCK_SYNC) {
+            BlockHeader blockHeader;
+            file.read(reinterpret_cast<char*>(record + sizeof(uint32_t)), HAT_BLOCK_HEADER_SIZE - sizeof(uint32_t));
+            unpackBlockHeader(record, blockHeader);
+            if (!file || pageOffsets.size() == HAT_SEEK_PAGE_ENTRIES || blockHeader.frames == 0 || blockHeader.frames > header.blockFrames ||
+                blockHeader.size < 2 || position + HAT_BLOCK_HEADER_SIZE + blockHeader.size > fileSize) {
+                break;
+            }
+
+            payload.resize(blockHeader.size);
+            file.read(reinterpret_cast<char*>(payload.data()), payload.size());
+            if (!file || calculateCRC32(payload.data(), payload.size()) != blockHeader.crc) {
+                break;
+            }
+
+            pageOffsets.push_back(position - dataStart);
+            blockCount++;
+            frames += blockHeader.frames;
+            lastBlockSeen = blockHeader.frames < header.blockFrames;
+            position += HAT_BLOCK_HEADER_SIZE + blockHeader.size;
+        } else if (recordSync == HAT_PAGE_SYNC) {
+            SeekPageHeader pageHeader;
+            file.read(reinterpret_cast<char*>(record + sizeof(uint32_t)), HAT_PAGE_HEADER_SIZE - sizeof(uint32_t));
+            unpackSeekPageHeader(record, pageHeader);
+            if (!file || pageHeader.entries != pageOffsets.size() || pageHeader.entries != HAT_SEEK_PAGE_ENTRIES) {
+                break;
+            }
+
+            // A complete page must list exactly the blocks walked since the last one
+            std::vector<uint8_t> page = packSeekPage(pageOffsets);
+            std::vector<uint8_t> stored(page.size() - HAT_PAGE_HEADER_SIZE);
+            file.read(reinterpret_cast<char*>(stored.data()), stored.size());
+            if (!file || !std::equal(stored.begin(), stored.end(), page.begin() + HAT_PAGE_HEADER_SIZE)) {
+                break;
+            }
+
+            coarseIndex.push_back(position - dataStart);
+            pageOffsets.clear();
+            position += page.size();
+        } else {
+            // Anything else, including a checkpoint that failed validation, is the damaged tail
+            break;
+        }
+    }
+
+    // The seek index counts blocks in 4 bytes
+    if (blockCount > UINT32_MAX) {
+        std::cerr << "\033[31m The recording has more blocks than a seek index can hold." << std::endl << "\033[39m";
+        return false;
+    }
+
+    // Replace the damaged tail with the last fine page and the coarse seek index
+    file.clear();
+    file.seekp(position);
+    if (!pageOffsets.empty()) {
+        coarseIndex.push_back(position - dataStart);
+
+        std::vector<uint8_t> page = packSeekPage(pageOffsets);
+        file.write(reinterpret_cast<const char*>(page.data()), page.size());
+    }
+
+    uint64_t seekMarker = static_cast<uint64_t>(file.tellp()) - dataStart;
+    std::vector<uint8_t> seekIndex = packSeekIndex(static_cast<uint32_t>(blockCount), coarseIndex);
+    file.write(reinterpret_cast<const char*>(seekIndex.data()), seekIndex.size());
+    uint64_t fileEnd = static_cast<uint64_t>(file.tellp());
+
+    uint64_t totalSamples = frames * header.channels;
+    uint64_t dataSize = seekMarker;
+    header.length = totalSamples;
+    header.datalength = dataSize;
+    header.compressionRatio = dataSize ? static_cast<float>(totalSamples * sizeof(int16_t)) / static_cast<float>(dataSize) : 0.0f;
+    trackInfo.seekMarker = seekMarker;
+
+    file.seekp(0);
+    writeHATHeader(file, header, trackInfo);
+    file.close();
+
+    if (file.fail() || !truncateFile(filePath, fileEnd)) {
+        std::cerr << "\033[31m Error writing the recovered file." << std::endl << "\033[39m";
+        return false;
+    }
+
+    std::cout << "\033[32m Recovered " << frames << " frames in " << blockCount << " blocks.\033[39m" << std::endl;
+    return true;
+}
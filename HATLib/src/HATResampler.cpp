@@ -0,0 +1,203 @@
+#include "HATResampler.h"
+#include "HATMix.h"
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HAT_RESAMPLE_SSE2
+#endif
+
+// Phase tables kept when the rates have no small ratio
+const uint32_t MAX_PHASES = 1024;
+
+static uint32_t greatestCommonDivisor(uint32_t a, uint32_t b) {
+    while (b != 0) {
+        uint32_t rest = a % b;
+        a = b;
+        b = rest;
+    }
+    return a;
+}
+
+// Zeroth order modified Bessel function, for the Kaiser window
+static double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+// Sum of a[i] * b[i]; count is a multiple of 4
+static float dotProduct(const float* a, const float* b, size_t count) {
+#ifdef HAT_RESAMPLE_SSE2
+    __m128 sum = _mm_setzero_ps();
+    for (size_t i = 0; i < count; i += 4) {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    __m128 swapped = _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(2, 3, 0, 1));
+    sum = _mm_add_ps(sum, swapped);
+    swapped = _mm_movehl_ps(swapped, sum);
+    return _mm_cvtss_f32(_mm_add_ss(sum, swapped));
+#else
+    float sum = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+#endif
+}
+
+HATResampler::HATResampler()
+    : channels(0), taps(0), upFactor(1), downFactor(1), phases(1), phaseScale(0), phase(0), historySize(0), historyFrames(0), historyStart(0) {
+}
+
+void HATResampler::setup(int inputRate, int outputRate, int channels, ResampleQuality quality, size_t maxFrames) {
+    uint32_t divisor = greatestCommonDivisor(static_cast<uint32_t>(inputRate), static_cast<uint32_t>(outputRate));
+    upFactor = static_cast<uint32_t>(outputRate) / divisor;
+    downFactor = static_cast<uint32_t>(inputRate) / divisor;
+    phases = std::min(upFactor, MAX_PHASES);
+    phaseScale = (static_cast<uint64_t>(phases) << 32) / upFactor;
+    phase = 0;
+    this->channels = static_cast<size_t>(channels);
+
+    size_t baseTaps = 16;
+    double beta = 7.0;
+    if (quality == RESAMPLE_FAST) {
+        baseTaps = 8;
+        beta = 5.0;
+    } else if (quality == RESAMPLE_BEST) {
+        baseTaps = 32;
+        beta = 9.0;
+    }
+
+    // Cutoff relative to the input's Nyquist frequency. A lower cutoff needs
+    // proportionally more taps for the same transition band.
+    double cutoff = std::min(1.0, static_cast<double>(upFactor) / downFactor);
+    taps = static_cast<size_t>(std::ceil(baseTaps / cutoff));
+    taps = (taps + 3) & ~static_cast<size_t>(3);
+
+    // Phase p of the table holds the taps for an output p / phases of an input
+    // frame past the middle tap. When the phases are rounded, a position just
+    // short of the next input frame rounds to p == phases, so that one gets a
+    // table too.
+    const double pi = 3.14159265358979323846;
+    double halfWidth = taps / 2.0;
+    double center = halfWidth - 1.0;
+    double windowScale = 1.0 / besselI0(beta);
+    uint32_t tables = phases < upFactor ? phases + 1 : phases;
+    filters.assign(static_cast<size_t>(tables) * taps, 0.0f);
+    for (uint32_t p = 0; p < tables; ++p) {
+        double fraction = static_cast<double>(p) / phases;
+        double sum = 0.0;
+        std::vector<double> filter(taps);
+        for (size_t j = 0; j < taps; ++j) {
+            double x = static_cast<double>(j) - center - fraction;
+            double ratio = x / halfWidth;
+            double window = ratio * ratio < 1.0 ? besselI0(beta * std::sqrt(1.0 - ratio * ratio)) * windowScale : 0.0;
+            double argument = pi * cutoff * x;
+            double sinc = argument == 0.0 ? 1.0 : std::sin(argument) / argument;
+            filter[j] = cutoff * sinc * window;
+            sum += filter[j];
+        }
+        // Unity gain at DC for every phase
+        for (size_t j = 0; j < taps; ++j) {
+            filters[p * taps + j] = static_cast<float>(filter[j] / sum);
+        }
+    }
+
+    historySize = maxFrames + taps;
+    history.assign(historySize * this->channels, 0.0f);
+    output.assign(maxFrames * this->channels, 0.0f);
+    reset();
+}
+
+void HATResampler::reset() {
+    // Zeros before the first input frame, so the first output lines up with it
+    historyFrames = taps / 2 - 1;
+    historyStart = 0;
+    std::fill(history.begin(), history.end(), 0.0f);
+}
+
+size_t HATResampler::getInputNeeded(size_t frames) const {
+    if (frames == 0) {
+        return 0;
+    }
+    uint64_t lastStart = historyStart + (phase + static_cast<uint64_t>(frames - 1) * downFactor) / upFactor;
+    uint64_t end = lastStart + taps;
+    return end > historyFrames ? static_cast<size_t>(end - historyFrames) : 0;
+}
+
+size_t HATResampler::getBufferedFrames() const {
+    size_t playing = historyStart + taps / 2 - 1;
+    return historyFrames > playing ? historyFrames - playing : 0;
+}
+
+size_t HATResampler::write(const int16_t* input, size_t frames) {
+    // Move what is still needed to the front to make room
+    if (historyStart > 0) {
+        for (size_t c = 0; c < channels; ++c) {
+            float* run = history.data() + c * historySize;
+            std::copy(run + historyStart, run + historyFrames, run);
+        }
+        historyFrames -= historyStart;
+        historyStart = 0;
+    }
+
+    frames = std::min(frames, historySize - historyFrames);
+    for (size_t c = 0; c < channels; ++c) {
+        float* run = history.data() + c * historySize + historyFrames;
+        for (size_t i = 0; i < frames; ++i) {
+            run[i] = static_cast<float>(input[i * channels + c]);
+        }
+    }
+    historyFrames += frames;
+    return frames;
+}
+
+size_t HATResampler::read(int16_t* dst, size_t frames) {
+    frames = std::min(frames, output.size() / std::max<size_t>(channels, 1));
+    // The step between outputs split into whole input frames and a phase
+    // remainder, so the loop needs no division
+    const size_t wholeStep = downFactor / upFactor;
+    const uint32_t phaseStep = downFactor % upFactor;
+    const float* filterTables = filters.data();
+    const float* runs = history.data();
+    float* out = output.data();
+    size_t start = historyStart;
+    uint32_t position = phase;
+    size_t produced = 0;
+    while (produced < frames && start + taps <= historyFrames) {
+        // Rounded to the nearest table when there are fewer tables than positions
+        uint32_t table = phases == upFactor ? position : static_cast<uint32_t>((static_cast<uint64_t>(position) * phaseScale + 0x80000000u) >> 32);
+        const float* filter = filterTables + static_cast<size_t>(table) * taps;
+        for (size_t c = 0; c < channels; ++c) {
+            out[produced * channels + c] = dotProduct(filter, runs + c * historySize + start, taps);
+        }
+        ++produced;
+
+        start += wholeStep;
+        position += phaseStep;
+        if (position >= upFactor) {
+            position -= upFactor;
+            ++start;
+        }
+    }
+    historyStart = start;
+    phase = position;
+
+    mixStore(dst, output.data(), produced * channels);
+    return produced;
+}
+
+uint64_t HATResampler::advance(uint64_t frames) {
+    uint64_t position = phase + frames * downFactor;
+    phase = static_cast<uint32_t>(position % upFactor);
+    reset();
+    return position / upFactor;
+}
@@ -0,0 +1,186 @@
+#include "HATStreamDecode.h"
+#include <iostream>
+#include <algorithm>
+
+HATStreamDecoder::HATStreamDecoder()
+    : state(STREAM_HEADER), header(), trackInfo(), blockHeader(), pendingSize(HAT_HEADER_SIZE), skipRemaining(0), afterSkip(STREAM_SYNC), framesDecoded(0), headerRead(false) {
+    pending.reserve(pendingSize);
+}
+
+const std::vector<int16_t>& HATStreamDecoder::feed(const uint8_t* data, size_t size) {
+    output.clear();
+
+    while (size > 0 && state != STREAM_END && state != STREAM_ERROR) {
+        if (state == STREAM_SKIP) {
+            size_t count = static_cast<size_t>(std::min<uint64_t>(size, skipRemaining));
+            data += count;
+            size -= count;
+            skipRemaining -= count;
+            if (skipRemaining == 0) {
+                state = afterSkip;
+                pendingSize = afterSkip == STREAM_HEADER ? HAT_HEADER_SIZE : sizeof(uint32_t);
+            }
+            continue;
+        }
+
+        size_t count = std::min(size, pendingSize - pending.size());
+        pending.insert(pending.end(), data, data + count);
+        data += count;
+        size -= count;
+
+        if (pending.size() == pendingSize) {
+            processPending();
+        }
+    }
+
+    return output;
+}
+
+void HATStreamDecoder::processPending() {
+    switch (state) {
+    case STREAM_HEADER: {
+        if (!unpackHATHeader(pending.data(), header, trackInfo)) {
+            state = STREAM_ERROR;
+            return;
+        }
+        // Nothing but the header bounds what is buffered, so blocks larger than
+        // any encoder writes are refused
+        if (header.channels == 0 || header.blockFrames == 0 || header.blockFrames > HAT_BLOCK_FRAMES) {
+            std::cerr << "\033[31m Invalid header! The file has no channels or an unsupported block size." << std::endl << "\033[39m";
+            state = STREAM_ERROR;
+            return;
+        }
+        if (header.metadataSize > 0) {
+            state = STREAM_METADATA;
+            pendingSize = header.metadataSize;
+        } else {
+            state = STREAM_SYNC;
+            pendingSize = sizeof(uint32_t);
+            headerRead = true;
+        }
+        break;
+    }
+    case STREAM_METADATA:
+        if (!unpackMetadata(pending.data(), pending.size(), trackInfo.metadata)) {
+            state = STREAM_ERROR;
+            return;
+        }
+        headerRead = true;
+        state = STREAM_SYNC;
+        pendingSize = sizeof(uint32_t);
+        break;
+    case STREAM_SYNC: {
+        // The sync word stays in `pending` and the record is unpacked once it is complete
+        uint32_t sync = unpackU32(pending.data());
+        if (sync == HAT_BLOCK_SYNC) {
+            state = STREAM_BLOCK_HEADER;
+            pendingSize = HAT_BLOCK_HEADER_SIZE;
+        } else if (sync == HAT_PAGE_SYNC) {
+            // Fine seek pages are interleaved with the blocks; a stream has no use for them
+            state = STREAM_PAGE_HEADER;
+            pendingSize = HAT_PAGE_HEADER_SIZE;
+        } else if (sync == HAT_TRACK_SYNC) {
+            // A multi-track file; its first track follows as a complete file image
+            state = STREAM_TRACK_HEADER;
+            pendingSize = HAT_TRACK_HEADER_SIZE;
+        } else if (sync == HAT_CHECKPOINT_SYNC) {
+            // So are the checkpoints of live recordings
+            state = STREAM_CHECKPOINT;
+            pendingSize = HAT_CHECKPOINT_HEADER_SIZE;
+        } else if (sync == HAT_INDEX_SYNC) {
+            // The coarse seek index follows the last block; nothing after it is audio
+            state = STREAM_END;
+            break;
+        } else {
+            std::cerr << "\033[31m Unknown record in the audio data! Data may be corrupted." << std::endl << "\033[39m";
+            state = STREAM_ERROR;
+            break;
+        }
+        return;
+    }
+    case STREAM_PAGE_HEADER: {
+        SeekPageHeader pageHeader;
+        unpackSeekPageHeader(pending.data(), pageHeader);
+        skipRemaining = static_cast<uint64_t>(pageHeader.entries) * sizeof(uint64_t);
+        afterSkip = STREAM_SYNC;
+        state = skipRemaining ? STREAM_SKIP : STREAM_SYNC;
+        pendingSize = sizeof(uint32_t);
+        break;
+    }
+    case STREAM_CHECKPOINT: {
+        CheckpointHeader checkpoint;
+        unpackCheckpointHeader(pending.data(), checkpoint);
+        skipRemaining = (static_cast<uint64_t>(checkpoint.pageCount) + checkpoint.partialCount) * sizeof(uint64_t) + sizeof(uint32_t);
+        afterSkip = STREAM_SYNC;
+        state = STREAM_SKIP;
+        pendingSize = sizeof(uint32_t);
+        break;
+    }
+    case STREAM_TRACK_HEADER: {
+        // The directory has one entry per track the header counts; the whole of
+        // it is kept so its CRC can be checked
+        uint64_t used = getTrackDirectorySize(pending.data()) - HAT_TRACK_HEADER_SIZE;
+        if (used < HAT_TRACK_ENTRY_SIZE || used > static_cast<uint64_t>(header.tracks) * HAT_TRACK_ENTRY_SIZE) {
+            std::cerr << "\033[31m Track directory is damaged." << std::endl << "\033[39m";
+            state = STREAM_ERROR;
+            return;
+        }
+        state = STREAM_TRACKS;
+        pendingSize = static_cast<size_t>(HAT_TRACK_HEADER_SIZE + used);
+        return;
+    }
+    case STREAM_TRACKS: {
+        // Skip from the end of the directory to the first track
+        std::vector<TrackDirectoryEntry> tracks;
+        if (!unpackTrackDirectory(pending.data(), pending.size(), tracks)) {
+            state = STREAM_ERROR;
+            return;
+        }
+        uint64_t directoryEnd = pending.size();
+        if (tracks[0].offset < directoryEnd) {
+            std::cerr << "\033[31m Track directory is damaged." << std::endl << "\033[39m";
+            state = STREAM_ERROR;
+            return;
+        }
+        skipRemaining = tracks[0].offset - directoryEnd;
+        afterSkip = STREAM_HEADER;
+        state = skipRemaining ? STREAM_SKIP : STREAM_HEADER;
+        pendingSize = HAT_HEADER_SIZE;
+        break;
+    }
+    case STREAM_BLOCK_HEADER:
+        unpackBlockHeader(pending.data(), blockHeader);
+        if (blockHeader.frames == 0 || blockHeader.frames > header.blockFrames || blockHeader.size < 2 ||
+            blockHeader.size > getMaxCompressedSize(static_cast<size_t>(blockHeader.frames) * header.channels)) {
+            std::cerr << "\033[31m Invalid block header! Data may be corrupted." << std::endl << "\033[39m";
+            state = STREAM_ERROR;
+            return;
+        }
+        state = STREAM_BLOCK;
+        pendingSize = blockHeader.size;
+        break;
+    case STREAM_BLOCK: {
+        if (calculateCRC32(pending.data(), pending.size()) != blockHeader.crc || !verifyChecksum(pending)) {
+            std::cerr << "\033[31m Checksum mismatch! Data may be corrupted." << std::endl << "\033[39m";
+            state = STREAM_ERROR;
+            return;
+        }
+
+        std::vector<int16_t> blockSamples = decompressData(pending, static_cast<size_t>(blockHeader.frames) * header.channels);
+        if (blockSamples.empty()) {
+            state = STREAM_ERROR;
+            return;
+        }
+        output.insert(output.end(), blockSamples.begin(), blockSamples.end());
+        framesDecoded += blockHeader.frames;
+
+        state = STREAM_SYNC;
+        pendingSize = sizeof(uint32_t);
+        break;
+    }
+    default:
+        break;
+    }
+
+    pending.clear();
+}
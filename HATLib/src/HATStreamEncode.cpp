@@ -0,0 +1,249 @@
+#include "HATStreamEncode.h"
+#include <iostream>
+#include <algorithm>
+
+HATStreamEncoder::HATStreamEncoder(const std::string& outputFilePath, int sampleRate, int bitRate, int audioChannels, const std::unordered_map<std::string, std::string>& metadata)
+    : outputFilePath(outputFilePath), sink(nullptr), header(), trackInfo(), framesWritten(0), compressedSize(0), blockCount(0), syncInterval(0), metadataPadding(HAT_METADATA_PADDING), blocksSinceSync(0), isOpen(false), finalized(false) {
+    header.version = HAT_VERSION;
+    header.channels = audioChannels;
+    header.spatialData[0] = 0.0f;
+    header.spatialData[1] = 0.0f;
+    header.spatialData[2] = 0.0f;
+    header.compressionMethod = LOSSLESS;
+    header.tracks = 1;
+    header.sampleRate = sampleRate;
+    header.bitRate = bitRate;
+    header.blockFrames = HAT_BLOCK_FRAMES;
+
+    trackInfo.metadata.insert(metadata.begin(), metadata.end());
+    trackInfo.metadata.insert(std::make_pair("artist", "Unknown Artist"));
+    trackInfo.metadata.insert(std::make_pair("description", "No Description"));
+    trackInfo.metadata.insert(std::make_pair("trackName", "Unknown Track"));
+    trackInfo.trackNumber = 1;
+}
+
+HATStreamEncoder::HATStreamEncoder(HATSink& sink, int sampleRate, int bitRate, int audioChannels, const std::unordered_map<std::string, std::string>& metadata)
+    : HATStreamEncoder(std::string(), sampleRate, bitRate, audioChannels, metadata) {
+    this->sink = &sink;
+}
+
+uint32_t HATStreamEncoder::addAttachment(const std::string& name, const std::string& mimeType, const std::vector<uint8_t>& data) {
+    AttachmentInfo attachment;
+    attachment.id = static_cast<uint32_t>(attachments.size());
+    attachment.name = name;
+    attachment.mimeType = mimeType;
+    attachment.offset = 0; // Assigned when finalize() writes it
+    attachment.size = data.size();
+    attachment.crc = calculateCRC32(data.data(), data.size());
+    attachments.push_back(attachment);
+    attachmentData.push_back(data);
+    return attachment.id;
+}
+
+bool HATStreamEncoder::open() {
+    if (isOpen) {
+        return true;
+    }
+    if (header.channels == 0) {
+        std::cerr << "Error: Cannot encode audio without channels." << std::endl;
+        return false;
+    }
+    uint64_t metadataSize = static_cast<uint64_t>(getMetadataChunkSize(trackInfo.metadata)) + metadataPadding;
+    if (metadataSize > HAT_MAX_METADATA_SIZE) {
+        std::cerr << "Error: The metadata is larger than " << HAT_MAX_METADATA_SIZE << " bytes." << std::endl;
+        return false;
+    }
+    header.metadataSize = static_cast<uint32_t>(metadataSize);
+
+    if (!sink) {
+        ownedSink.reset(new HATFileSink());
+        if (!ownedSink->open(outputFilePath)) {
+            std::cerr << "Error opening output file." << std::endl;
+            ownedSink.reset();
+            return false;
+        }
+        sink = ownedSink.get();
+    }
+
+    // Length, data length and seek marker are patched in by finalize()
+    if (!writeHeaders(false)) {
+        std::cerr << "Error writing output file." << std::endl;
+        return false;
+    }
+
+    blockData.reserve(static_cast<size_t>(header.blockFrames) * header.channels);
+    pageOffsets.reserve(HAT_SEEK_PAGE_ENTRIES);
+    isOpen = true;
+
+    return syncInterval == 0 || syncToDisk();
+}
+
+bool HATStreamEncoder::write(const int16_t* data, size_t frames) {
+    if (finalized || !open()) {
+        return false;
+    }
+
+    size_t channels = header.channels;
+    size_t blockSamples = static_cast<size_t>(header.blockFrames) * channels;
+    const int16_t* end = data + frames * channels;
+    while (data < end) {
+        size_t count = std::min(blockSamples - blockData.size(), static_cast<size_t>(end - data));
+        blockData.insert(blockData.end(), data, data + count);
+        data += count;
+
+        if (blockData.size() == blockSamples && !flushBlock()) {
+            return false;
+        }
+    }
+
+    framesWritten += frames;
+    return true;
+}
+
+bool HATStreamEncoder::finalize() {
+    if (finalized) {
+        return true;
+    }
+    if (!open()) {
+        return false;
+    }
+
+    if ((!blockData.empty() && !flushBlock()) || (!pageOffsets.empty() && !flushPage())) {
+        return false;
+    }
+
+    // Coarse seek index, pointed to by the seek marker
+    uint64_t seekMarker = sink->tell() - getDataOffset(header);
+    std::vector<uint8_t> seekIndex = packSeekIndex(static_cast<uint32_t>(blockCount), coarseIndex);
+    if (!sink->write(seekIndex.data(), seekIndex.size())) {
+        std::cerr << "Error writing output file." << std::endl;
+        return false;
+    }
+    if (!attachments.empty() && !writeAttachments()) {
+        return false;
+    }
+
+    uint64_t totalSamples = framesWritten * header.channels;
+    header.length = totalSamples;
+    header.datalength = seekMarker;
+    header.compressionRatio = compressedSize ? static_cast<float>(totalSamples * sizeof(int16_t)) / static_cast<float>(compressedSize) : 0.0f;
+    trackInfo.seekMarker = seekMarker;
+
+    // Make sure everything the header will point at is on disk before the header is
+    if (syncInterval > 0 && !syncToDisk()) {
+        return false;
+    }
+
+    bool written = writeHeaders(true);
+    if (written && syncInterval > 0) {
+        syncToDisk();
+    }
+    written = sink->close() && written;
+
+    finalized = true;
+    if (!written) {
+        std::cerr << "Error writing output file." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool HATStreamEncoder::flushBlock() {
+    // The seek index and checkpoints count blocks in 4 bytes
+    if (blockCount == UINT32_MAX) {
+        std::cerr << "Error: The file cannot hold any more blocks." << std::endl;
+        return false;
+    }
+
+    float blockRatio = 0.0f;
+    std::vector<uint8_t> block = compressData(blockData, blockRatio);
+
+    pageOffsets.push_back(sink->tell() - getDataOffset(header));
+
+    BlockHeader blockHeader;
+    blockHeader.sync = HAT_BLOCK_SYNC;
+    blockHeader.frames = static_cast<uint32_t>(blockData.size() / header.channels);
+    blockHeader.size = static_cast<uint32_t>(block.size());
+    blockHeader.crc = calculateCRC32(block.data(), block.size());
+    uint8_t packedHeader[HAT_BLOCK_HEADER_SIZE];
+    packBlockHeader(blockHeader, packedHeader);
+    if (!sink->write(packedHeader, sizeof(packedHeader)) || !sink->write(block.data(), block.size())) {
+        std::cerr << "Error writing output file." << std::endl;
+        return false;
+    }
+
+    compressedSize += HAT_BLOCK_HEADER_SIZE + block.size();
+    blockCount++;
+    blockData.clear();
+
+    if (pageOffsets.size() == HAT_SEEK_PAGE_ENTRIES && !flushPage()) {
+        return false;
+    }
+
+    if (syncInterval > 0 && ++blocksSinceSync >= syncInterval) {
+        blocksSinceSync = 0;
+        if (!writeCheckpoint() || !syncToDisk()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool HATStreamEncoder::flushPage() {
+    coarseIndex.push_back(sink->tell() - getDataOffset(header));
+
+    std::vector<uint8_t> page = packSeekPage(pageOffsets);
+    bool written = sink->write(page.data(), page.size());
+    pageOffsets.clear();
+
+    if (!written) {
+        std::cerr << "Error writing output file." << std::endl;
+    }
+    return written;
+}
+
+bool HATStreamEncoder::writeCheckpoint() {
+    // Assembled in memory so the CRC covers exactly what is written
+    std::vector<uint8_t> record = packCheckpoint(static_cast<uint32_t>(blockCount), coarseIndex, pageOffsets);
+    if (!sink->write(record.data(), record.size())) {
+        std::cerr << "Error writing output file." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool HATStreamEncoder::writeAttachments() {
+    for (size_t i = 0; i < attachments.size(); ++i) {
+        attachments[i].offset = sink->tell() - getDataOffset(header);
+        if (!sink->write(attachmentData[i].data(), attachmentData[i].size())) {
+            std::cerr << "Error writing output file." << std::endl;
+            return false;
+        }
+        std::vector<uint8_t>().swap(attachmentData[i]);
+    }
+
+    header.attachmentDirectory = sink->tell() - getDataOffset(header);
+    std::vector<uint8_t> directory = packAttachmentDirectory(attachments);
+    if (!sink->write(directory.data(), directory.size())) {
+        std::cerr << "Error writing output file." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool HATStreamEncoder::syncToDisk() {
+    if (!sink->sync()) {
+        std::cerr << "Error syncing output file to disk." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool HATStreamEncoder::writeHeaders(bool patch) {
+    std::vector<uint8_t> bytes(HAT_HEADER_SIZE + header.metadataSize);
+    packHATHeader(header, trackInfo, bytes.data());
+    if (!packMetadata(trackInfo.metadata, bytes.data() + HAT_HEADER_SIZE, header.metadataSize)) {
+        return false;
+    }
+    return patch ? sink->writeAt(0, bytes.data(), bytes.size()) : sink->write(bytes.data(), bytes.size());
+}
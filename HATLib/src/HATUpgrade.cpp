@@ -0,0 +1,76 @@
+#include "HATUpgrade.h"
+#include "HATFormat.h"
+#include "HATStreamEncode.h"
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <cstring>
+
+// Layout of the 1.0 header, which the 1.0 encoder wrote field by field in the
+// byte order of x86, so little-endian
+const size_t HAT_V1_HEADER_SIZE = 818;
+const size_t HAT_V1_TEXT_SIZE = 256;
+
+static std::string getText(const uint8_t* data) {
+    return std::string(reinterpret_cast<const char*>(data), strnlen(reinterpret_cast<const char*>(data), HAT_V1_TEXT_SIZE));
+}
+
+bool upgradeHATFile(const std::string& inputFilePath, const std::string& outputFilePath) {
+    std::ifstream input(inputFilePath, std::ios::binary | std::ios::ate);
+    if (!input.is_open()) {
+        std::cerr << "\033[31m Error opening input file." << std::endl << "\033[39m";
+        return false;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(input.tellg());
+    input.seekg(0);
+
+    uint8_t header[HAT_V1_HEADER_SIZE];
+    if (fileSize < sizeof(header) || !input.read(reinterpret_cast<char*>(header), sizeof(header)) || std::memcmp(header, "1.0", 4) != 0) {
+        std::cerr << "\033[31m Not a HAT 1.0 file." << std::endl << "\033[39m";
+        return false;
+    }
+
+    uint8_t channels = header[4];
+    uint32_t sampleRate = unpackU32(header + 26);
+    uint32_t bitRate = unpackU32(header + 30);
+    uint32_t length = unpackU32(header + 34);
+    uint32_t dataLength = unpackU32(header + 38);
+    if (channels == 0 || length % channels != 0 || dataLength < 2) {
+        std::cerr << "\033[31m The HAT 1.0 header is damaged." << std::endl << "\033[39m";
+        return false;
+    }
+    if (sizeof(header) + static_cast<uint64_t>(dataLength) > fileSize) {
+        std::cerr << "\033[31m The HAT 1.0 audio data is truncated." << std::endl << "\033[39m";
+        return false;
+    }
+
+    std::unordered_map<std::string, std::string> metadata;
+    const char* keys[] = { "artist", "description", "trackName" };
+    for (size_t i = 0; i < 3; ++i) {
+        std::string value = getText(header + 42 + i * HAT_V1_TEXT_SIZE);
+        if (!value.empty()) {
+            metadata[keys[i]] = value;
+        }
+    }
+    int32_t trackNumber = static_cast<int32_t>(unpackU32(header + 810));
+
+    // 1.0 compressed the whole track as one stream, exactly like a single block today
+    std::vector<uint8_t> payload(dataLength);
+    if (!input.read(reinterpret_cast<char*>(payload.data()), payload.size())) {
+        std::cerr << "\033[31m The HAT 1.0 audio data is truncated." << std::endl << "\033[39m";
+        return false;
+    }
+    if (!verifyChecksum(payload)) {
+        std::cerr << "\033[31m Checksum mismatch! Data may be corrupted." << std::endl << "\033[39m";
+        return false;
+    }
+    std::vector<int16_t> samples = decompressData(payload, length);
+    if (samples.size() != length) {
+        return false;
+    }
+    std::vector<uint8_t>().swap(payload);
+
+    HATStreamEncoder encoder(outputFilePath, static_cast<int>(sampleRate), static_cast<int>(bitRate), channels, metadata);
+    encoder.setTrackNumber(trackNumber);
+    return encoder.write(samples.data(), samples.size() / channels) && encoder.finalize();
+}
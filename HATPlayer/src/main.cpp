@@ -1,53 +1,129 @@
 #define MINIAUDIO_IMPLEMENTATION
 #include "miniaudio.h"
 #include "HATDecode.h"
+#include "HATMixer.h"
+#include "HATStreamDecode.h"
+#include "HATRingBuffer.h"
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <thread>
+#include <chrono>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
-struct UserData {
-    std::vector<int16_t>* audioData;
-    const HATDecoder* decoder;
-};
+// Output channels; the first two carry the panning
+const int OUTPUT_CHANNELS = 2;
+// Files that can play at once
+const uint32_t MAX_VOICES = 64;
+
+// Playback callback: the mixer only copies out of buffers its decode thread
+// fills. No allocation, locks or I/O.
+void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
+    HATMixer* mixer = reinterpret_cast<HATMixer*>(pDevice->pUserData);
+    mixer->mix(reinterpret_cast<int16_t*>(pOutput), frameCount);
 
-// Function to calculate the volume based on the distance from the origin
-float calculateVolume(float x, float y, float z) {
-    float distance = std::sqrt(x * x + y * y + z * z);
-    return 1.0f / (1.0f + distance); // Simple inverse distance attenuation
+    (void)pInput;
 }
 
-// Function to calculate the panning based on the x coordinate
-float calculatePanning(float x) {
-    return x / std::sqrt(x * x + 1); // Normalized panning value
+// Stream playback callback: copies whole frames out of the ring buffer the
+// main thread fills, and leaves silence where the stream has not caught up
+struct StreamPlayback {
+    HATRingBuffer<int16_t>* ring;
+    uint32_t channels;
+};
+
+void stream_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
+    StreamPlayback* playback = reinterpret_cast<StreamPlayback*>(pDevice->pUserData);
+    size_t frames = std::min<size_t>(frameCount, playback->ring->available() / playback->channels);
+    playback->ring->read(reinterpret_cast<int16_t*>(pOutput), frames * playback->channels);
+
+    (void)pInput;
 }
 
-// Callback function for audio playback
-void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
-    UserData* userData = reinterpret_cast<UserData*>(pDevice->pUserData);
-    auto* audioData = userData->audioData;
-    const HATDecoder* decoder = userData->decoder;
-    static size_t currentSample = 0;
-    size_t sampleCount = frameCount * pDevice->playback.channels;
+// Plays a HAT file piped into stdin. Nothing can be seeked, so the bytes go
+// through a HATStreamDecoder and each block plays as soon as it is decoded.
+int playStdin() {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    HATStreamDecoder decoder;
+    std::vector<uint8_t> chunk(64 * 1024);
+    std::unique_ptr<HATRingBuffer<int16_t>> ring;
+    StreamPlayback playback;
+    ma_device device;
+    bool deviceReady = false;
 
-    const float* spatialData = decoder->getSpatialData();
-    float volume = calculateVolume(spatialData[0], spatialData[1], spatialData[2]);
-    float panning = calculatePanning(spatialData[0]);
+    while (!decoder.isFinished() && !decoder.hasError()) {
+        size_t bytes = std::fread(chunk.data(), 1, chunk.size(), stdin);
+        if (bytes == 0) {
+            break;
+        }
+        const std::vector<int16_t>& samples = decoder.feed(chunk.data(), bytes);
 
-    for (size_t i = 0; i < sampleCount; i += 2) { // Assuming stereo output
-        if (currentSample < audioData->size()) {
-            int16_t sample = (*audioData)[currentSample++];
-            float leftSample = sample * volume * (1.0f - panning);
-            float rightSample = sample * volume * (1.0f + panning);
+        // The device is opened at the stream's own format as soon as its header is in
+        if (!deviceReady && decoder.hasHeader()) {
+            std::cout << "Streaming " << decoder.getChannels() << " channels at " << decoder.getSampleRate() << " Hz from stdin" << std::endl;
+            std::cout << "Artist: " << decoder.getArtist() << std::endl;
+            std::cout << "Track Name: " << decoder.getTrackName() << std::endl;
 
-            reinterpret_cast<int16_t*>(pOutput)[i] = static_cast<int16_t>(leftSample);
-            reinterpret_cast<int16_t*>(pOutput)[i + 1] = static_cast<int16_t>(rightSample);
-        } else {
-            reinterpret_cast<int16_t*>(pOutput)[i] = 0;
-            reinterpret_cast<int16_t*>(pOutput)[i + 1] = 0;
+            playback.channels = static_cast<uint32_t>(decoder.getChannels());
+            ring.reset(new HATRingBuffer<int16_t>(static_cast<size_t>(decoder.getSampleRate()) * playback.channels));
+            playback.ring = ring.get();
+
+            ma_device_config deviceConfig = ma_device_config_init(ma_device_type_playback);
+            deviceConfig.playback.format = ma_format_s16;
+            deviceConfig.playback.channels = playback.channels;
+            deviceConfig.sampleRate = static_cast<ma_uint32>(decoder.getSampleRate());
+            deviceConfig.dataCallback = stream_callback;
+            deviceConfig.pUserData = &playback;
+            if (ma_device_init(NULL, &deviceConfig, &device) != MA_SUCCESS) {
+                std::cerr << "Failed to initialize playback device." << std::endl;
+                return -1;
+            }
+            deviceReady = true;
+            if (ma_device_start(&device) != MA_SUCCESS) {
+                std::cerr << "Failed to start playback device." << std::endl;
+                ma_device_uninit(&device);
+                return -1;
+            }
+        }
+
+        // Wait for the callback to make room, which paces reading to playback
+        size_t written = 0;
+        while (written < samples.size()) {
+            written += ring->write(samples.data() + written, samples.size() - written);
+            if (written < samples.size()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
         }
     }
 
-    (void)pInput;
+    if (!deviceReady) {
+        std::cerr << "Error: stdin does not hold a HAT file." << std::endl;
+        return 1;
+    }
+    // Let what was decoded play out
+    while (ring->available() >= playback.channels) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ma_device_uninit(&device);
+
+    if (decoder.hasError()) {
+        return 1;
+    }
+    if (!decoder.isFinished()) {
+        std::cerr << "Error: The stream ended before its last block." << std::endl;
+        return 1;
+    }
+    std::cout << "Played " << decoder.getFramesDecoded() << " frames." << std::endl;
+    return 0;
 }
 
 void printHeaderInfo(const HATDecoder& decoder) {
@@ -60,8 +136,8 @@ void printHeaderInfo(const HATDecoder& decoder) {
     std::cout << "Tracks: " << decoder.getTracks() << std::endl;
     std::cout << "Sample Rate: " << decoder.getSampleRate() << std::endl;
     std::cout << "Bit Rate: " << decoder.getBitRate() << std::endl;
-    std::cout << "Length: " << decoder.getAudioData().size() << std::endl;
-    std::cout << "Data Length: " << decoder.getAudioData().size() * sizeof(int16_t) << std::endl; // Added Data Length
+    std::cout << "Length: " << decoder.getFrameCount() * decoder.getChannels() << std::endl;
+    std::cout << "Data Length: " << decoder.getFrameCount() * decoder.getChannels() * sizeof(int16_t) << std::endl; // Added Data Length
 }
 
 void printTrackInfo(const HATDecoder& decoder) {
@@ -89,7 +165,11 @@ void printColorCodedSample(int16_t sample) {
     }
 }
 
-void displayAudioData(const std::vector<int16_t>& audioData) {
+void displayAudioData(HATDecoder& decoder, uint64_t startFrame) {
+    size_t frames = (100 + decoder.getChannels() - 1) / decoder.getChannels();
+    std::vector<int16_t> audioData(frames * decoder.getChannels());
+    audioData.resize(decoder.decodeRange(startFrame, frames, audioData.data()) * decoder.getChannels());
+
     std::cout << "Audio Data (first 100 samples):" << std::endl;
     for (size_t i = 0; i < 100 && i < audioData.size(); ++i) {
         printColorCodedSample(audioData[i]);
@@ -97,40 +177,88 @@ void displayAudioData(const std::vector<int16_t>& audioData) {
     std::cout << std::endl;
 }
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: HATPlayer <input HAT file>" << std::endl;
+    if (argc == 2 && std::string(argv[1]) == "--stdin") {
+        return playStdin();
+    }
+
+    // Positional arguments come first, then the options
+    int positional = 1;
+    while (positional < argc && std::strncmp(argv[positional], "--", 2) != 0) {
+        ++positional;
+    }
+    std::vector<std::string> extraFiles;
+    ResampleQuality quality = RESAMPLE_MEDIUM;
+    bool validArgs = positional >= 2 && positional <= 4;
+    for (int i = positional; validArgs && i < argc; i += 2) {
+        validArgs = i + 1 < argc;
+        if (!validArgs) {
+            break;
+        }
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "--add") {
+            extraFiles.push_back(value);
+        } else if (option == "--quality" && value == "fast") {
+            quality = RESAMPLE_FAST;
+        } else if (option == "--quality" && value == "medium") {
+            quality = RESAMPLE_MEDIUM;
+        } else if (option == "--quality" && value == "best") {
+            quality = RESAMPLE_BEST;
+        } else {
+            validArgs = false;
+        }
+    }
+    if (!validArgs) {
+        std::cerr << "Usage: HATPlayer <input HAT file> [start seconds] [track] [--add <HAT file>]... [--quality fast|medium|best]" << std::endl;
+        std::cerr << "       HATPlayer --stdin" << std::endl;
         return 1;
     }
 
     std::string inputFilePath = argv[1];
+    double startSeconds = positional >= 3 ? std::atof(argv[2]) : 0.0;
+    uint32_t track = positional == 4 ? static_cast<uint32_t>(std::atoi(argv[3])) : 0;
+
+    // Stream the file instead of decoding it up front
+    std::unique_ptr<HATDecoder> decoder(new HATDecoder(inputFilePath));
+    if (!decoder->selectTrack(track)) {
+        return 1;
+    }
 
-    HATDecoder decoder(inputFilePath);
-    decoder.decode();
+    uint64_t startFrame = static_cast<uint64_t>(startSeconds * decoder->getSampleRate());
+    if (startFrame > 0 && !decoder->seek(startFrame)) {
+        return 1;
+    }
 
     // Display header info
-    printHeaderInfo(decoder);
+    printHeaderInfo(*decoder);
 
     // Display track info
-    printTrackInfo(decoder);
+    printTrackInfo(*decoder);
 
     // Display audio data
-    displayAudioData(decoder.getAudioData());
+    displayAudioData(*decoder, startFrame);
     std::cout << std::endl;
 
-    // Initialize miniaudio
+    std::vector<std::unique_ptr<HATDecoder>> extras;
+    for (size_t i = 0; i < extraFiles.size(); ++i) {
+        extras.push_back(std::unique_ptr<HATDecoder>(new HATDecoder(extraFiles[i])));
+        if (!extras.back()->open()) {
+            return 1;
+        }
+    }
+
+    // Initialize miniaudio at the device's own sample rate; the mixer converts
+    // every file to it
     ma_device_config deviceConfig;
     ma_device device;
     ma_result result;
 
-    UserData userData = {const_cast<std::vector<int16_t>*>(&decoder.getAudioData()), &decoder};
-
     deviceConfig = ma_device_config_init(ma_device_type_playback);
     deviceConfig.playback.format = ma_format_s16;
-    deviceConfig.playback.channels = 2; // Using stereo for panning
-    deviceConfig.sampleRate = decoder.getSampleRate() * 2; // Adjust based on your audio data
+    deviceConfig.playback.channels = OUTPUT_CHANNELS;
+    deviceConfig.sampleRate = 0;
 
     deviceConfig.dataCallback = data_callback;
-    deviceConfig.pUserData = &userData;
 
     result = ma_device_init(NULL, &deviceConfig, &device);
     if (result != MA_SUCCESS) {
@@ -138,6 +266,26 @@ int main(int argc, char* argv[]) {
         return -1;
     }
 
+    // Every file plays as a voice at the position in its header. Each voice's
+    // first block is decoded as it starts, so playback begins almost immediately.
+    std::unique_ptr<HATMixer> mixer(new HATMixer(MAX_VOICES, static_cast<int>(device.sampleRate), OUTPUT_CHANNELS, quality));
+    device.pUserData = mixer.get();
+    std::cout << "Device Sample Rate: " << device.sampleRate << std::endl;
+
+    const float* spatialData = decoder->getSpatialData();
+    bool playing = mixer->play(std::move(decoder), spatialData[0], spatialData[1], spatialData[2]) != HAT_INVALID_VOICE;
+    for (size_t i = 0; playing && i < extras.size(); ++i) {
+        const float* position = extras[i]->getSpatialData();
+        playing = mixer->play(std::move(extras[i]), position[0], position[1], position[2]) != HAT_INVALID_VOICE;
+        if (!playing) {
+            std::cerr << "Error playing " << extraFiles[i] << std::endl;
+        }
+    }
+    if (!playing) {
+        ma_device_uninit(&device);
+        return 1;
+    }
+
     result = ma_device_start(&device);
     if (result != MA_SUCCESS) {
         std::cerr << "Failed to start playback device." << std::endl;
@@ -149,5 +297,8 @@ int main(int argc, char* argv[]) {
     std::cin.get(); // Wait for user input to stop playback
 
     ma_device_uninit(&device);
+    if (mixer->getUnderruns() > 0) {
+        std::cerr << "Warning: " << mixer->getUnderruns() << " times a voice ran out of decoded audio." << std::endl;
+    }
     return 0;
 }
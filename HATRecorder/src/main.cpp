@@ -0,0 +1,223 @@
+#define MINIAUDIO_IMPLEMENTATION
+#include "miniaudio.h"
+#include "HATStreamEncode.h"
+#include "HATRecover.h"
+#include "HATRingBuffer.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_map>
+
+// Blocks between checkpoints, about a second of audio at 48 kHz
+const uint32_t SYNC_INTERVAL_BLOCKS = 12;
+
+struct UserData {
+    HATRingBuffer<int16_t>* ring;
+    std::atomic<uint64_t> droppedFrames;
+    uint32_t channels;
+    uint32_t sampleRate;
+    bool synthetic;
+    std::vector<int16_t> scratch; // Synthetic input, allocated before the device starts
+    uint64_t syntheticFrame;
+};
+
+// Fills dst with a different sine tone per channel, standing in for a capture device
+void generateSynthetic(UserData* userData, int16_t* dst, ma_uint32 frameCount) {
+    // M_PI is not standard C++ and MSVC only defines it on request
+    const double pi = 3.14159265358979323846;
+    for (ma_uint32 frame = 0; frame < frameCount; ++frame) {
+        double t = static_cast<double>(userData->syntheticFrame++) / userData->sampleRate;
+        for (uint32_t channel = 0; channel < userData->channels; ++channel) {
+            double frequency = 220.0 + 55.0 * channel;
+            dst[frame * userData->channels + channel] = static_cast<int16_t>(8000.0 * std::sin(2.0 * pi * frequency * t));
+        }
+    }
+}
+
+// Capture callback: only copies into the ring buffer. No allocation, locks or I/O.
+void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
+    UserData* userData = reinterpret_cast<UserData*>(pDevice->pUserData);
+    size_t channels = userData->channels;
+
+    const int16_t* input = reinterpret_cast<const int16_t*>(pInput);
+    ma_uint32 framesLeft = frameCount;
+    while (framesLeft > 0) {
+        ma_uint32 frames = framesLeft;
+        if (userData->synthetic) {
+            frames = std::min<ma_uint32>(framesLeft, static_cast<ma_uint32>(userData->scratch.size() / channels));
+            generateSynthetic(userData, userData->scratch.data(), frames);
+            input = userData->scratch.data();
+        }
+
+        // Only whole frames go in, so the encoder thread never sees a split frame
+        size_t fit = std::min<size_t>(frames, userData->ring->space() / channels);
+        userData->ring->write(input, fit * channels);
+        if (fit < frames) {
+            userData->droppedFrames += frames - fit;
+        }
+
+        if (!userData->synthetic) {
+            input += frames * channels;
+        }
+        framesLeft -= frames;
+    }
+
+    (void)pOutput;
+}
+
+// Encoder thread: drains the ring buffer into the stream encoder until told to stop
+void encodeLoop(HATRingBuffer<int16_t>& ring, HATStreamEncoder& encoder, uint32_t channels, std::atomic<bool>& running, std::atomic<bool>& failed) {
+    std::vector<int16_t> chunk(static_cast<size_t>(HAT_BLOCK_FRAMES) * channels);
+
+    while (true) {
+        bool stopping = !running.load();
+        size_t samples = (ring.available() / channels) * channels;
+        if (samples == 0) {
+            if (stopping) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+
+        samples = ring.read(chunk.data(), std::min(samples, chunk.size()));
+        if (!encoder.write(chunk.data(), samples / channels)) {
+            failed = true;
+            running = false;
+            break;
+        }
+    }
+}
+
+void printUsage() {
+    std::cerr << "Usage: HATRecorder <output HAT file> [--channels N] [--rate HZ] [--seconds S] [--artist NAME] [--null]" << std::endl;
+    std::cerr << "       HATRecorder --recover <HAT file>" << std::endl;
+    std::cerr << "  --null     Use miniaudio's null backend with synthetic input instead of a capture device" << std::endl;
+    std::cerr << "  --recover  Repair a recording that was interrupted before it was finished" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 3 && std::string(argv[1]) == "--recover") {
+        return recoverHATFile(argv[2]) ? 0 : 1;
+    }
+    if (argc < 2 || argv[1][0] == '-') {
+        printUsage();
+        return 1;
+    }
+
+    std::string outputFilePath = argv[1];
+    uint32_t channels = 2;
+    uint32_t sampleRate = 48000;
+    double seconds = 0.0;
+    bool useNullBackend = false;
+    std::unordered_map<std::string, std::string> metadata;
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--null") {
+            useNullBackend = true;
+        } else if (i + 1 < argc && arg == "--channels") {
+            channels = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (i + 1 < argc && arg == "--rate") {
+            sampleRate = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (i + 1 < argc && arg == "--seconds") {
+            seconds = std::atof(argv[++i]);
+        } else if (i + 1 < argc && arg == "--artist") {
+            metadata["artist"] = argv[++i];
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (channels == 0 || channels > 32 || sampleRate == 0) {
+        std::cerr << "Channels must be between 1 and 32 and the sample rate must not be 0." << std::endl;
+        return 1;
+    }
+
+    HATStreamEncoder encoder(outputFilePath, sampleRate, sampleRate * channels * 16, channels, metadata);
+    encoder.setSyncInterval(SYNC_INTERVAL_BLOCKS);
+    if (!encoder.open()) {
+        return 1;
+    }
+
+    // Two seconds of headroom between the callback and the encoder thread
+    HATRingBuffer<int16_t> ring(static_cast<size_t>(sampleRate) * channels * 2);
+
+    UserData userData;
+    userData.ring = &ring;
+    userData.droppedFrames = 0;
+    userData.channels = channels;
+    userData.sampleRate = sampleRate;
+    userData.synthetic = useNullBackend;
+    userData.scratch.resize(static_cast<size_t>(HAT_BLOCK_FRAMES) * channels);
+    userData.syntheticFrame = 0;
+
+    // Initialize miniaudio
+    ma_context context;
+    ma_backend nullBackend[] = { ma_backend_null };
+    if (ma_context_init(useNullBackend ? nullBackend : NULL, useNullBackend ? 1 : 0, NULL, &context) != MA_SUCCESS) {
+        std::cerr << "Failed to initialize audio context." << std::endl;
+        return -1;
+    }
+
+    ma_device_config deviceConfig = ma_device_config_init(ma_device_type_capture);
+    deviceConfig.capture.format = ma_format_s16;
+    deviceConfig.capture.channels = channels;
+    deviceConfig.sampleRate = sampleRate;
+    deviceConfig.dataCallback = data_callback;
+    deviceConfig.pUserData = &userData;
+
+    ma_device device;
+    if (ma_device_init(&context, &deviceConfig, &device) != MA_SUCCESS) {
+        std::cerr << "Failed to initialize capture device." << std::endl;
+        ma_context_uninit(&context);
+        return -1;
+    }
+
+    std::atomic<bool> running(true);
+    std::atomic<bool> failed(false);
+    std::thread encoderThread(encodeLoop, std::ref(ring), std::ref(encoder), channels, std::ref(running), std::ref(failed));
+
+    if (ma_device_start(&device) != MA_SUCCESS) {
+        std::cerr << "Failed to start capture device." << std::endl;
+        running = false;
+        encoderThread.join();
+        ma_device_uninit(&device);
+        ma_context_uninit(&context);
+        return -1;
+    }
+
+    if (seconds > 0.0) {
+        std::cout << "Recording for " << seconds << " seconds..." << std::endl;
+        auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+        while (running && std::chrono::steady_clock::now() < end) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    } else {
+        std::cout << "Recording... press Enter to stop." << std::endl;
+        std::cin.get();
+    }
+
+    // Stop capturing first so the encoder thread can drain everything that was captured
+    ma_device_uninit(&device);
+    ma_context_uninit(&context);
+    running = false;
+    encoderThread.join();
+
+    if (failed || !encoder.finalize()) {
+        std::cerr << "Recording failed; run HATRecorder --recover on the file to keep what was written." << std::endl;
+        return 1;
+    }
+
+    std::cout << "Recorded " << encoder.getFramesWritten() << " frames";
+    if (userData.droppedFrames > 0) {
+        std::cout << ", \033[31m" << userData.droppedFrames << " frames dropped\033[39m";
+    }
+    std::cout << "." << std::endl;
+    return 0;
+}